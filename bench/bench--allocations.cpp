@@ -0,0 +1,147 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "bench.hpp"
+
+using namespace std;
+
+/*
+ * Heap allocations are counted by replacing the global operator new. The
+ * counters report the number of allocations per iteration of each operation,
+ * RELIC and OpenABE allocations made with malloc are not included.
+ */
+static std::atomic<size_t> nb_allocations{0};
+
+void* operator new(size_t size) {
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+
+static const std::string policy = "(Attr_5 and (Attr_1 or Attr_2)) and ((Attr_3 and Attr_4) or (Attr_6 and Attr_7) or ((Attr_8 or Attr_9) and Attr_10))";
+
+static KPABE_DPVS& get_kpabe() {
+  static KPABE_DPVS kpabe;
+  static bool is_setup = kpabe.setup();
+  if (!is_setup) {
+    cerr << "Error: Could not setup KPABE_DPVS" << endl;
+    exit(1);
+  }
+  return kpabe;
+}
+
+static void set_counters(benchmark::State& state, size_t nb_allocs) {
+  state.counters["Allocs_per_iter"] = benchmark::Counter(nb_allocs, benchmark::Counter::kAvgIterations);
+}
+
+static void BM_Allocations_Getters(benchmark::State& state) {
+  auto& kpabe = get_kpabe();
+  size_t nb_allocs = 0;
+
+  for (auto _ : state) {
+    size_t start = nb_allocations.load();
+    const auto& pk = kpabe.get_public_key();
+    const auto& mk = kpabe.get_master_key();
+    benchmark::DoNotOptimize(&pk.get_h1());
+    benchmark::DoNotOptimize(&mk.get_hh1());
+    nb_allocs += nb_allocations.load() - start;
+  }
+
+  set_counters(state, nb_allocs);
+}
+
+static void BM_Allocations_Keygen(benchmark::State& state, int nb_wl_bl) {
+  auto& kpabe = get_kpabe();
+  auto wl = generateAttributesList("wl_url_", nb_wl_bl);
+  auto bl = generateAttributesList("bl_url_", nb_wl_bl);
+  size_t nb_allocs = 0;
+
+  for (auto _ : state) {
+    size_t start = nb_allocations.load();
+    auto dec_key = kpabe.keygen(policy, wl, bl);
+    nb_allocs += nb_allocations.load() - start;
+    benchmark::DoNotOptimize(dec_key);
+  }
+
+  set_counters(state, nb_allocs);
+  state.counters["Nb_WL_BL"] = nb_wl_bl;
+}
+
+static void BM_Allocations_Encrypt(benchmark::State& state, int nb_attributes) {
+  auto& kpabe = get_kpabe();
+  auto attributes = generateAttributes(nb_attributes);
+  uint8_t ss_key[RLC_MD_LEN];
+  size_t nb_allocs = 0;
+
+  for (auto _ : state) {
+    KPABE_DPVS_CIPHERTEXT ctx(attributes, "www.example.com");
+    size_t start = nb_allocations.load();
+    ctx.encrypt(ss_key, kpabe.get_public_key());
+    nb_allocs += nb_allocations.load() - start;
+  }
+
+  set_counters(state, nb_allocs);
+  state.counters["Nb_Attributes"] = nb_attributes;
+}
+
+static void BM_Allocations_Decrypt(benchmark::State& state, const std::string& url) {
+  auto& kpabe = get_kpabe();
+  auto dec_key = kpabe.keygen(policy, generateAttributesList("wl_url_", 10),
+                              generateAttributesList("bl_url_", 10));
+  uint8_t ss_key[RLC_MD_LEN];
+  size_t nb_allocs = 0;
+
+  KPABE_DPVS_CIPHERTEXT ctx(generateAttributes(10), url);
+  ctx.encrypt(ss_key, kpabe.get_public_key());
+
+  for (auto _ : state) {
+    size_t start = nb_allocations.load();
+    ctx.decrypt(ss_key, *dec_key);
+    nb_allocs += nb_allocations.load() - start;
+  }
+
+  set_counters(state, nb_allocs);
+}
+
+
+int main(int argc, char** argv)
+{
+  InitializeOpenABE();
+
+  __relic_print_params();
+
+  benchmark::RegisterBenchmark("Allocations_Getters", BM_Allocations_Getters);
+
+  for (int n : {1, 10, 100}) {
+    benchmark::RegisterBenchmark("Allocations_Keygen", [n](benchmark::State& state) {
+      BM_Allocations_Keygen(state, n);
+    })->Unit(benchmark::kMillisecond);
+  }
+
+  for (int n : {1, 10, 100}) {
+    benchmark::RegisterBenchmark("Allocations_Encrypt", [n](benchmark::State& state) {
+      BM_Allocations_Encrypt(state, n);
+    })->Unit(benchmark::kMillisecond);
+  }
+
+  benchmark::RegisterBenchmark("Allocations_Decrypt_URL_in_Whitelist", [](benchmark::State& state) {
+    BM_Allocations_Decrypt(state, "wl_url_1");
+  })->Unit(benchmark::kMillisecond);
+
+  benchmark::RegisterBenchmark("Allocations_Decrypt_Policy_Satisfied", [](benchmark::State& state) {
+    BM_Allocations_Decrypt(state, "www.example.com");
+  })->Unit(benchmark::kMillisecond);
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+
+  ShutdownOpenABE();
+
+  return 0;
+}
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "bench.hpp"
+#include "policy_program.hpp"
 
 using namespace std;
 
@@ -26,10 +27,17 @@ class KPABEManager {
       }
     }
 
-    auto getCiphertext(std::string attributes, std::string url) {
+    // With a randomizer, the ciphertext is encrypted under a randomized public key
+    auto getCiphertext(std::string attributes, std::string url, ZP *randomizer = nullptr) {
       KPABE_DPVS_CIPHERTEXT ciphertext(attributes, url);
       uint8_t ss_key[RLC_MD_LEN];
-      ciphertext.encrypt(ss_key, this->kpabe.get_public_key());
+      if (randomizer != nullptr) {
+        auto [public_key, k] = this->kpabe.get_public_key().randomize();
+        ciphertext.encrypt(ss_key, public_key);
+        *randomizer = k;
+      } else {
+        ciphertext.encrypt(ss_key, this->kpabe.get_public_key());
+      }
 
       ByteString key_bytes; key_bytes.appendArray(ss_key, RLC_MD_LEN);
       return std::make_pair(ciphertext, key_bytes);
@@ -52,7 +60,8 @@ class KPABEManager {
     KPABE_DPVS kpabe;
 };
 
-static void BM_KPABE_DPVS_Decryption(benchmark::State& state, ciphertext_params params) {
+static void BM_KPABE_DPVS_Decryption(benchmark::State& state, ciphertext_params params,
+                                     bool randomized = false) {
   std::string policy = "(Attr_5 and (Attr_1 or Attr_2)) and ((Attr_3 and Attr_4) or (Attr_6 and Attr_7) or ((Attr_8 or Attr_9) and Attr_10))";
   if (params.nb_attributes < 10) {
     policy = "Attr_1";
@@ -60,12 +69,14 @@ static void BM_KPABE_DPVS_Decryption(benchmark::State& state, ciphertext_params
 
   KPABEManager kpabe_manager;
   auto dec_key = kpabe_manager.getDecryptionKey(params.size, params.size, policy);
-  auto result = kpabe_manager.getCiphertext(params.attributes, params.url);
+  ZP randomizer;
+  auto result = kpabe_manager.getCiphertext(params.attributes, params.url,
+                                            randomized ? &randomizer : nullptr);
   auto ciphertext = result.first;
 
   for (auto _ : state) {
     uint8_t ss_key_rec[RLC_MD_LEN];
-    auto success = ciphertext.decrypt(ss_key_rec, *dec_key);
+    auto success = ciphertext.decrypt(ss_key_rec, *dec_key, randomizer);
     if (success != params.__expected) {
       std::cerr << "Error: expected " << params.__expected << " but got " << success << std::endl;
       exit(1);
@@ -85,6 +96,35 @@ static void BM_KPABE_DPVS_Decryption(benchmark::State& state, ciphertext_params
   state.counters["Nb_WL_BL"] = params.size;
 }
 
+// Satisfiability of one key policy for a new resource: the policy is compiled
+// once per key, or parsed and shared by the LSSS at each check
+static void BM_KPABE_DPVS_PolicyCheck(benchmark::State& state, ciphertext_params params,
+                                      bool compiled) {
+  std::string policy = "(Attr_5 and (Attr_1 or Attr_2)) and ((Attr_3 and Attr_4) or (Attr_6 and Attr_7) or ((Attr_8 or Attr_9) and Attr_10))";
+  if (params.nb_attributes < 10) {
+    policy = "Attr_1";
+  }
+  PolicyProgram program(policy);
+
+  for (auto _ : state) {
+    bool success;
+    if (compiled) {
+      success = program.is_satisfied(AttributeSet(params.attributes));
+    } else {
+      auto policy_tree = createPolicyTree(policy);
+      auto attributes_list = createAttributeList(params.attributes);
+      OpenABELSSS lsss;
+      success = lsss.recoverCoefficients(policy_tree.get(), attributes_list.get());
+    }
+    if (success != params.__expected) {
+      std::cerr << "Error: expected " << params.__expected << " but got " << success << std::endl;
+      exit(1);
+    }
+  }
+
+  state.counters["Nb_Attributes"] = params.nb_attributes;
+}
+
 
 int main(int argc, char** argv)
 {
@@ -131,12 +171,32 @@ int main(int argc, char** argv)
       });
     }
 
+    { // attributes_1, url : satisfies the policy, randomized public key
+      ciphertext_params params = {attributes_1, nb_attr_in_ciphertext, url, taille_listes, true};
+      benchmark::RegisterBenchmark("Decryption_Policy_Satisfied_Randomized", [params](benchmark::State& state) {
+        BM_KPABE_DPVS_Decryption(state, params, true);
+      });
+    }
+
     { // attributes_2, url : does not satisfy the policy
       ciphertext_params params = {attributes_2, nb_attr_in_ciphertext, url, taille_listes, false};
       benchmark::RegisterBenchmark("Decryption_Policy_NOT_Satisfied", [params](benchmark::State& state) {
         BM_KPABE_DPVS_Decryption(state, params);
       });
     }
+
+    if (taille_listes == 1) {
+      for (bool compiled : {false, true}) {
+        for (const auto& [attributes, expected] : {std::pair(attributes_1, true), std::pair(attributes_2, false)}) {
+          ciphertext_params params = {attributes, nb_attr_in_ciphertext, url, 0, expected};
+          std::string name = std::string(compiled ? "Policy_Check_Compiled" : "Policy_Check_LSSS") +
+                             (expected ? "_Satisfied" : "_NOT_Satisfied");
+          benchmark::RegisterBenchmark(name.c_str(), [params, compiled](benchmark::State& state) {
+            BM_KPABE_DPVS_PolicyCheck(state, params, compiled);
+          })->Unit(benchmark::kMicrosecond);
+        }
+      }
+    }
   }
 
   ::benchmark::Initialize(&argc, argv);
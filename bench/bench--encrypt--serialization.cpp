@@ -28,7 +28,8 @@ static void BM_KPABE_DPVS_SerializationCiphertext(benchmark::State& state, int n
   state.counters["Size"] = ctx_bytes.size();
 }
 
-static void BM_KPABE_DPVS_DeserializationCiphertext(benchmark::State& state, int nb_attributes) {
+static void BM_KPABE_DPVS_DeserializationCiphertext(benchmark::State& state, int nb_attributes,
+                                                    bool validate) {
   KPABE_DPVS kpabe;
   if (!kpabe.setup()) {
     cerr << "Error: Could not setup KPABE_DPVS" << endl;
@@ -43,6 +44,7 @@ static void BM_KPABE_DPVS_DeserializationCiphertext(benchmark::State& state, int
   ctx.serialize(ctx_bytes);
   for (auto _ : state) {
     KPABE_DPVS_CIPHERTEXT ctx_deserialized;
+    ctx_deserialized.set_validation(validate);
     ctx_deserialized.deserialize(ctx_bytes);
   }
 
@@ -51,6 +53,27 @@ static void BM_KPABE_DPVS_DeserializationCiphertext(benchmark::State& state, int
   state.counters["Size"] = ctx_bytes.size();
 }
 
+static void BM_KPABE_DPVS_CompactSerializationCiphertext(benchmark::State& state, int nb_attributes) {
+  KPABE_DPVS kpabe;
+  if (!kpabe.setup()) {
+    cerr << "Error: Could not setup KPABE_DPVS" << endl;
+    exit(1);
+  }
+
+  uint8_t ss_key[RLC_MD_LEN];
+  KPABE_DPVS_CIPHERTEXT ctx(generateAttributes(nb_attributes), "www.example.com");
+  ctx.encrypt(ss_key, kpabe.get_public_key());
+
+  vector<uint8_t> ctx_bytes;
+  for (auto _ : state) {
+    ctx.serializeCompact(ctx_bytes);
+  }
+
+  // Set the custom value for size
+  state.counters["Nb_Attributes"] = nb_attributes;
+  state.counters["Size"] = ctx_bytes.size();
+}
+
 
 int main(int argc, char** argv) {
 
@@ -68,7 +91,20 @@ int main(int argc, char** argv) {
 
   for (auto n_att : nb_attributes_list) {
     benchmark::RegisterBenchmark("BM_KPABE_DPVS_DeserializationCiphertext", [n_att](benchmark::State& state) {
-      BM_KPABE_DPVS_DeserializationCiphertext(state, n_att);
+      BM_KPABE_DPVS_DeserializationCiphertext(state, n_att, true);
+    });
+  }
+
+  // Without the subgroup check, for ciphertexts from a trusted cache
+  for (auto n_att : nb_attributes_list) {
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_TrustedDeserializationCiphertext", [n_att](benchmark::State& state) {
+      BM_KPABE_DPVS_DeserializationCiphertext(state, n_att, false);
+    });
+  }
+
+  for (auto n_att : nb_attributes_list) {
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_CompactSerializationCiphertext", [n_att](benchmark::State& state) {
+      BM_KPABE_DPVS_CompactSerializationCiphertext(state, n_att);
     });
   }
 
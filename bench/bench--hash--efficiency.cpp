@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+#include "bench.hpp"
+#include "md_batch.hpp"
+
+using namespace std;
+
+
+// Scalars of a list of urls, as keygen needs them for the white and black lists
+static void BM_KPABE_DPVS_HashToZP(benchmark::State& state, bool batch) {
+  auto urls = generateAttributesList("www.blacklisted-url-", state.range(0));
+  BPGroup group;
+
+  for (auto _ : state) {
+    if (batch) {
+      vector<ZP> zps = hashToZP(urls, group.order);
+      benchmark::DoNotOptimize(zps.data());
+    } else {
+      vector<ZP> zps;
+      zps.reserve(urls.size());
+      for (const auto& url : urls) zps.push_back(hashToZP(url, group.order));
+      benchmark::DoNotOptimize(zps.data());
+    }
+  }
+
+  state.counters["Nb_URLs"] = urls.size();
+  state.SetLabel(batch ? md_batch_method() : "md_map");
+}
+
+// The digests only, without the reduction modulo the group order
+static void BM_KPABE_DPVS_MdMap(benchmark::State& state, bool batch) {
+  auto urls = generateAttributesList("www.blacklisted-url-", state.range(0));
+  vector<md_digest_t> digests(urls.size());
+
+  for (auto _ : state) {
+    if (batch) {
+      md_map_batch(digests, urls);
+    } else {
+      for (size_t i = 0; i < urls.size(); i++) {
+        md_map(digests[i].data(), (const uint8_t*)urls[i].data(), urls[i].size());
+      }
+    }
+    benchmark::DoNotOptimize(digests.data());
+  }
+
+  state.counters["Nb_URLs"] = urls.size();
+  state.SetLabel(batch ? md_batch_method() : "md_map");
+}
+
+BENCHMARK_CAPTURE(BM_KPABE_DPVS_HashToZP, PerString, false)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_KPABE_DPVS_HashToZP, Batch, true)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_KPABE_DPVS_MdMap, PerString, false)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_KPABE_DPVS_MdMap, Batch, true)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv)
+{
+  InitializeOpenABE();
+
+  __relic_print_params();
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+
+  ShutdownOpenABE();
+
+  return 0;
+}
@@ -41,7 +41,8 @@ static void BM_KPABE_DPVS_SerializeDecryptionKey(benchmark::State& state, policy
   state.counters["Nb_BL"] = params.nbl;
 }
 
-static void BM_KPABE_DPVS_DeserializeDecryptionKey(benchmark::State& state, policy_params params) {
+static void BM_KPABE_DPVS_DeserializeDecryptionKey(benchmark::State& state, policy_params params,
+                                                   bool lazy, bool compressed = true) {
   KPABE_DPVS kpabe;
   if (!kpabe.setup()) {
     cerr << "Error: Could not setup KPABE_DPVS" << endl;
@@ -58,9 +59,11 @@ static void BM_KPABE_DPVS_DeserializeDecryptionKey(benchmark::State& state, poli
   }
 
   OpenABEByteString dec_key_bytes;
+  dec_key->set_compression(compressed);
   dec_key->serialize(dec_key_bytes);
   for (auto _ : state) {
     KPABE_DPVS_DECRYPTION_KEY dec_key_deserialized;
+    dec_key_deserialized.set_lazy_decoding(lazy);
     dec_key_deserialized.deserialize(dec_key_bytes);
 
     // Check if deserialized decryption key is correct
@@ -102,7 +105,22 @@ int main(int argc, char** argv)
   for (auto num : ListSizes) {
     policy_params params = {num.first, num.second, policy};
     benchmark::RegisterBenchmark("BM_KPABE_DPVS_DeserializeDecryptionKey", [params](benchmark::State& state) {
-      BM_KPABE_DPVS_DeserializeDecryptionKey(state, params);
+      BM_KPABE_DPVS_DeserializeDecryptionKey(state, params, false);
+    });
+  }
+
+  for (auto num : ListSizes) {
+    policy_params params = {num.first, num.second, policy};
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_LazyDeserializeDecryptionKey", [params](benchmark::State& state) {
+      BM_KPABE_DPVS_DeserializeDecryptionKey(state, params, true);
+    });
+  }
+
+  // Uncompressed points: larger keys, but no square root when loading them
+  for (auto num : ListSizes) {
+    policy_params params = {num.first, num.second, policy};
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_DeserializeUncompressedDecryptionKey", [params](benchmark::State& state) {
+      BM_KPABE_DPVS_DeserializeDecryptionKey(state, params, false, false);
     });
   }
 
@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+
+using namespace std;
+
+/*
+ * Decryption keys whose black list goes beyond the 65,535 entries of format
+ * v1. The key is generated once per size, then written and read in format v2.
+ */
+static const std::string policy = "(Attr_5 and (Attr_1 or Attr_2)) and ((Attr_3 and Attr_4) or (Attr_6 and Attr_7) or ((Attr_8 or Attr_9) and Attr_10))";
+
+static const KPABE_DPVS_DECRYPTION_KEY& get_large_key(int nb_bl) {
+  static std::map<int, std::optional<KPABE_DPVS_DECRYPTION_KEY>> keys;
+
+  auto& dec_key = keys[nb_bl];
+  if (!dec_key) {
+    KPABE_DPVS kpabe;
+    if (!kpabe.setup()) {
+      cerr << "Error: Could not setup KPABE_DPVS" << endl;
+      exit(1);
+    }
+    dec_key = kpabe.keygen(policy, generateAttributesList("WL_url_", 10),
+                           generateAttributesList("BL_url_", nb_bl));
+    if (!dec_key) {
+      cerr << "Error: Could not generate keys" << endl;
+      exit(1);
+    }
+  }
+  return *dec_key;
+}
+
+static void BM_KPABE_DPVS_SerializeLargeKeyV2(benchmark::State& state, int nb_bl) {
+  const auto& dec_key = get_large_key(nb_bl);
+
+  for (auto _ : state) {
+    std::ostringstream os;
+    dec_key.serializeV2(os);
+    benchmark::DoNotOptimize(os);
+  }
+
+  state.counters["Size"] = dec_key.getSizeInBytesV2();
+  state.counters["Nb_BL"] = nb_bl;
+}
+
+static void BM_KPABE_DPVS_DeserializeLargeKeyV2(benchmark::State& state, int nb_bl, bool parallel) {
+  const auto& dec_key = get_large_key(nb_bl);
+
+  std::vector<uint8_t> dec_key_bytes;
+  dec_key.serializeV2(dec_key_bytes);
+  for (auto _ : state) {
+    KPABE_DPVS_DECRYPTION_KEY dec_key_deserialized;
+    dec_key_deserialized.set_parallel_decoding(parallel);
+    dec_key_deserialized.deserialize(dec_key_bytes);
+  }
+
+  state.counters["Size"] = dec_key_bytes.size();
+  state.counters["Nb_BL"] = nb_bl;
+}
+
+
+int main(int argc, char** argv)
+{
+  InitializeOpenABE();
+
+  __relic_print_params();
+
+  for (int nb_bl : {1000, 70000}) {
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_SerializeLargeKeyV2", [nb_bl](benchmark::State& state) {
+      BM_KPABE_DPVS_SerializeLargeKeyV2(state, nb_bl);
+    })->Unit(benchmark::kMillisecond);
+  }
+
+  for (int nb_bl : {1000, 70000}) {
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_DeserializeLargeKeyV2", [nb_bl](benchmark::State& state) {
+      BM_KPABE_DPVS_DeserializeLargeKeyV2(state, nb_bl, false);
+    })->Unit(benchmark::kMillisecond);
+  }
+
+  for (int nb_bl : {1000, 70000}) {
+    benchmark::RegisterBenchmark("BM_KPABE_DPVS_ParallelDeserializeLargeKeyV2", [nb_bl](benchmark::State& state) {
+      BM_KPABE_DPVS_DeserializeLargeKeyV2(state, nb_bl, true);
+    })->Unit(benchmark::kMillisecond)->UseRealTime();
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+
+  ShutdownOpenABE();
+
+  return 0;
+}
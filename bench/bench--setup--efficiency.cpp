@@ -45,9 +45,61 @@ static void BM_KPABE_DPVS_ValidateDerivedPublicKey(benchmark::State& state) {
   }
 }
 
+// The check before the random combination: one multiplication by k per vector
+static bool validate_derived_key_per_point(const KPABE_DPVS_PUBLIC_KEY& pk,
+                                           const KPABE_DPVS_PUBLIC_KEY& other, const ZP& k) {
+  return (pk.get_d1() * k == other.get_d1() && pk.get_d3() * k == other.get_d3() &&
+          pk.get_f1() * k == other.get_f1() && pk.get_f2() * k == other.get_f2() &&
+          pk.get_f3() * k == other.get_f3() &&
+          pk.get_g1() * k == other.get_g1() && pk.get_g2() * k == other.get_g2() &&
+          pk.get_h1() * k == other.get_h1() && pk.get_h2() * k == other.get_h2() &&
+          pk.get_h3() * k == other.get_h3());
+}
+
+static void BM_KPABE_DPVS_ValidateDerivedPublicKeyPerPoint(benchmark::State& state) {
+  KPABE_DPVS kpabe;
+  if (!kpabe.setup()) {
+    cerr << "Error: Could not setup KPABE_DPVS" << endl;
+    exit(1);
+  }
+
+  auto pk = kpabe.get_public_key();
+  auto __pair = pk.randomize();
+  for (auto _ : state) {
+    if (!validate_derived_key_per_point(pk, __pair.first, __pair.second)) {
+      cerr << "Error: Could not validate public key" << endl;
+      exit(1);
+    }
+  }
+}
+
+// Randomization by the server, then validation by the client
+static void BM_KPABE_DPVS_RandomizeAndValidate(benchmark::State& state) {
+  KPABE_DPVS kpabe;
+  if (!kpabe.setup()) {
+    cerr << "Error: Could not setup KPABE_DPVS" << endl;
+    exit(1);
+  }
+
+  auto pk = kpabe.get_public_key();
+  bool per_point = state.range(0);
+  for (auto _ : state) {
+    auto __pair = pk.randomize();
+    bool is_valid = per_point ? validate_derived_key_per_point(pk, __pair.first, __pair.second)
+                              : pk.validate_derived_key(__pair.first, __pair.second);
+    if (!is_valid) {
+      cerr << "Error: Could not validate public key" << endl;
+      exit(1);
+    }
+  }
+  state.SetLabel(per_point ? "per point" : "random combination");
+}
+
 BENCHMARK(BM_KPABE_DPVS_Setup);
 BENCHMARK(BM_KPABE_DPVS_PublicKeyRandomization);
 BENCHMARK(BM_KPABE_DPVS_ValidateDerivedPublicKey);
+BENCHMARK(BM_KPABE_DPVS_ValidateDerivedPublicKeyPerPoint);
+BENCHMARK(BM_KPABE_DPVS_RandomizeAndValidate)->Arg(0)->Arg(1);
 
 int main(int argc, char** argv)
 {
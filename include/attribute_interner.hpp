@@ -0,0 +1,69 @@
+/**
+ * @file attribute_interner.hpp
+ * @brief Process-wide dictionary of attribute labels
+ * @date 2024-06-27
+ *
+ */
+
+#ifndef __ATTRIBUTE_INTERNER_HPP__
+#define __ATTRIBUTE_INTERNER_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <abe_lsss/abe_lsss.h>
+
+typedef uint32_t attribute_id_t;
+
+struct InternedAttribute {
+  attribute_id_t id;
+  std::string name;
+  std::string hash_key;   // OpenABEHashKey(name), the key of ctx_att and key_att
+  ZP zp;                  // hashToZP(name) modulo the group order
+};
+
+/*
+ * Maps attribute labels to dense ids, and keeps the values derived from them:
+ * encryption, key generation and decryption hash each label once per process
+ * instead of once per use. Strings are never removed, the dictionary is meant
+ * for the bounded vocabulary of the policies and the attributes given to
+ * encrypt: urls, and names read from ciphertexts, must not be interned. The
+ * entries are not moved once created, the references returned stay valid.
+ * Lookups take a shared lock, only a new string takes the exclusive lock.
+ */
+class AttributeInterner {
+  public:
+    AttributeInterner() = default;
+
+    AttributeInterner(const AttributeInterner&) = delete;
+    AttributeInterner& operator=(const AttributeInterner&) = delete;
+
+    // Entry of name, created on first use. std::length_error once every id
+    // is taken
+    const InternedAttribute& intern(const std::string &name);
+
+    // Entry of name if it is interned, nullptr otherwise: nothing is created
+    const InternedAttribute* find(const std::string &name) const;
+
+    // Create the missing entries of names, their scalars hashed in one batch
+    void intern_all(const std::vector<std::string> &names);
+
+    // Entry of an id given by intern, std::out_of_range otherwise
+    const InternedAttribute& get(attribute_id_t id) const;
+
+    size_t size() const;
+
+    // Dictionary shared by the library
+    static AttributeInterner& global();
+
+  private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, attribute_id_t> ids;
+    std::deque<InternedAttribute> entries;
+};
+
+#endif // __ATTRIBUTE_INTERNER_HPP__
@@ -0,0 +1,87 @@
+/**
+ * @file attribute_table.hpp
+ * @brief Vectors indexed by attribute, stored in one contiguous array
+ * @date 2024-06-24
+ *
+ */
+
+#ifndef __ATTRIBUTE_TABLE_HPP__
+#define __ATTRIBUTE_TABLE_HPP__
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Structure of arrays: the vectors of all attributes follow each other in one
+ * array (a fixed size vector holds its points inline), the names are in a
+ * second array at the same positions, and an index maps a name to its
+ * position. Rows keep their insertion order. Iterating gives (name, vector)
+ * pairs, as with a map.
+ *
+ * As with std::vector, adding a row invalidates the references to the others.
+ */
+template <class Vec>
+class AttributeTable {
+  public:
+    class const_iterator {
+      public:
+        const_iterator(const AttributeTable *table, size_t i) : table(table), i(i) {}
+
+        std::pair<const std::string&, const Vec&> operator*() const {
+          return {this->table->names[this->i], this->table->rows[this->i]};
+        }
+        const_iterator& operator++() { this->i++; return *this; }
+        bool operator!=(const const_iterator &other) const { return this->i != other.i; }
+
+      private:
+        const AttributeTable *table;
+        size_t i;
+    };
+
+    size_t size() const { return this->rows.size(); }
+    bool empty() const { return this->rows.empty(); }
+
+    void reserve(size_t n) {
+      this->names.reserve(n);
+      this->rows.reserve(n);
+      this->index.reserve(n);
+    }
+
+    void clear() {
+      this->names.clear();
+      this->rows.clear();
+      this->index.clear();
+    }
+
+    // Vector of name, a row is appended if name is missing
+    Vec& operator[](const std::string &name) {
+      auto [it, inserted] = this->index.try_emplace(name, this->rows.size());
+      if (inserted) {
+        this->names.push_back(name);
+        this->rows.emplace_back();
+      }
+      return this->rows[it->second];
+    }
+
+    // Position of name, size() if not found
+    size_t find(const std::string &name) const {
+      auto it = this->index.find(name);
+      return (it != this->index.end()) ? it->second : this->size();
+    }
+
+    const std::vector<std::string>& get_names() const { return this->names; }
+    const std::vector<Vec>& get_rows() const { return this->rows; }
+    std::vector<Vec>& get_rows() { return this->rows; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, this->size()); }
+
+  private:
+    std::vector<std::string> names;
+    std::vector<Vec> rows;
+    std::unordered_map<std::string, size_t> index;
+};
+
+#endif // __ATTRIBUTE_TABLE_HPP__
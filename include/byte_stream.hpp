@@ -0,0 +1,357 @@
+/**
+ * @file byte_stream.hpp
+ * @brief Serialization directly into, and parsing directly from, caller memory
+ * @date 2024-06-04
+ *
+ */
+
+#ifndef __BYTE_STREAM_HPP__
+#define __BYTE_STREAM_HPP__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <abe_lsss/abe_lsss.h>
+
+#include "vector_ec.hpp"
+
+// Number of bytes of value as a varint (LEB128, 7 bits per byte)
+inline size_t varint_size(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) { value >>= 7; size++; }
+  return size;
+}
+
+/*
+ * Writes the format of OpenABEByteString (BYTESTRING header, smartPack,
+ * big-endian integers) into a fixed span, without intermediate buffers. The
+ * caller sizes the span with getSizeInBytes().
+ */
+class ByteWriter {
+  public:
+    explicit ByteWriter(std::span<uint8_t> output) : output(output), offset(0) {}
+
+    // Number of bytes written so far
+    size_t size() const { return this->offset; }
+
+    // Reserve len bytes and return a pointer on them
+    uint8_t* advance(size_t len) {
+      if (len > this->output.size() - this->offset) {
+        throw std::length_error("Output buffer is too small");
+      }
+      uint8_t *ptr = this->output.data() + this->offset;
+      this->offset += len;
+      return ptr;
+    }
+
+    void put8(uint8_t value) { *this->advance(1) = value; }
+
+    void put16(uint16_t value) {
+      uint8_t *ptr = this->advance(2);
+      ptr[0] = value >> 8; ptr[1] = value;
+    }
+
+    void put32(uint32_t value) {
+      uint8_t *ptr = this->advance(4);
+      ptr[0] = value >> 24; ptr[1] = value >> 16; ptr[2] = value >> 8; ptr[3] = value;
+    }
+
+    void put64(uint64_t value) {
+      this->put32(value >> 32); this->put32(value);
+    }
+
+    void putVarint(uint64_t value) {
+      while (value >= 0x80) {
+        this->put8((value & 0x7F) | 0x80);
+        value >>= 7;
+      }
+      this->put8(value);
+    }
+
+    void putBytes(const uint8_t *data, size_t len) {
+      if (len > 0) memcpy(this->advance(len), data, len);
+    }
+
+    // A writer on the next len bytes, see StreamWriter
+    ByteWriter next(size_t len) { return ByteWriter({this->advance(len), len}); }
+
+    // Header of OpenABEByteString::serialize, len is the size of the content
+    void putHeader(size_t len) {
+      this->put8(BYTESTRING);
+      this->put32(len);
+    }
+
+    // Header of OpenABEByteString::smartPack, len is the size of the content
+    void putPackHeader(size_t len) {
+      if (len <= UINT8_MAX) {
+        this->put8(PACK_8); this->put8(len);
+      }
+      else if (len <= UINT16_MAX) {
+        this->put8(PACK_16); this->put16(len);
+      }
+      else {
+        this->put8(PACK_32); this->put32(len);
+      }
+    }
+
+    void putString(const std::string &str) {
+      this->putPackHeader(str.size());
+      this->putBytes(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+    }
+
+    // Equivalent of vect.serialize(temp, compressed); result.smartPack(temp);
+    template <class Vec>
+    void putVector(const Vec &vect, bool compressed = BIN_COMPRESSED) {
+      this->putPackHeader(Vec::getEncodedSize(compressed));
+      vect.serialize(*this, compressed);
+    }
+
+  private:
+    std::span<uint8_t> output;
+    size_t offset;
+};
+
+/*
+ * Reads the format written by ByteWriter from a read-only span. Nothing is
+ * copied: strings and points are decoded straight from the input memory,
+ * which must outlive the reader. Reading past the end throws.
+ */
+class ByteReader {
+  public:
+    explicit ByteReader(std::span<const uint8_t> input) : input(input), offset(0) {}
+
+    size_t position() const { return this->offset; }
+    size_t remaining() const { return this->input.size() - this->offset; }
+
+    // Return a pointer on the next len bytes and skip them
+    const uint8_t* advance(size_t len) {
+      if (len > this->remaining()) {
+        throw std::out_of_range("Truncated input");
+      }
+      const uint8_t *ptr = this->input.data() + this->offset;
+      this->offset += len;
+      return ptr;
+    }
+
+    uint8_t get8() { return *this->advance(1); }
+
+    uint8_t peek8() const {
+      if (this->remaining() < 1) throw std::out_of_range("Truncated input");
+      return this->input[this->offset];
+    }
+
+    uint16_t get16() {
+      const uint8_t *ptr = this->advance(2);
+      return (uint16_t(ptr[0]) << 8) | ptr[1];
+    }
+
+    uint32_t get32() {
+      const uint8_t *ptr = this->advance(4);
+      return (uint32_t(ptr[0]) << 24) | (uint32_t(ptr[1]) << 16) | (uint32_t(ptr[2]) << 8) | ptr[3];
+    }
+
+    uint64_t get64() {
+      uint64_t high = this->get32();
+      return (high << 32) | this->get32();
+    }
+
+    uint64_t getVarint() {
+      uint64_t value = 0;
+      for (unsigned shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = this->get8();
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+      }
+      throw std::runtime_error("Invalid varint");
+    }
+
+    // A reader on the next len bytes, see StreamReader
+    ByteReader next(size_t len) { return ByteReader({this->advance(len), len}); }
+
+    // Header of OpenABEByteString::serialize, return false if it is invalid
+    bool getHeader() {
+      if (this->remaining() < 5 || this->get8() != BYTESTRING) return false;
+      return this->get32() <= this->remaining();
+    }
+
+    // Header of OpenABEByteString::smartPack, return the size of the content
+    size_t getPackHeader() {
+      switch (this->get8()) {
+        case PACK_8:  return this->get8();
+        case PACK_16: return this->get16();
+        case PACK_32: return this->get32();
+        default: throw std::runtime_error("Invalid pack header");
+      }
+    }
+
+    // Content of a smartPack, as a view on the input
+    std::span<const uint8_t> getPacked() {
+      size_t len = this->getPackHeader();
+      return {this->advance(len), len};
+    }
+
+    std::string getString() {
+      auto bytes = this->getPacked();
+      return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    // Equivalent of temp = input.smartUnpack(&index); vect.deserialize(temp);
+    // Return true if the points of the vector are compressed
+    template <class Vec>
+    bool getVector(Vec &vect) {
+      size_t len = this->getPackHeader();
+      size_t start = this->offset;
+      vect.deserialize(*this);
+      if (this->offset - start != len) {
+        throw std::runtime_error("Invalid vector size");
+      }
+      return len == Vec::getEncodedSize(true);
+    }
+
+    // Same, the points must be compressed or not as given
+    template <class Vec>
+    void getVector(Vec &vect, bool compressed) {
+      if (this->getPackHeader() != Vec::getEncodedSize(compressed)) {
+        throw std::runtime_error("Invalid vector size");
+      }
+      vect.deserialize(*this);
+    }
+
+  private:
+    std::span<const uint8_t> input;
+    size_t offset;
+};
+
+/*
+ * Writes to an ostream through a buffer of fixed capacity. Formats written
+ * entry by entry (see format v2) ask next() for a writer on each entry, so the
+ * memory used does not depend on the size of the object.
+ */
+class StreamWriter {
+  public:
+    explicit StreamWriter(std::ostream &os, size_t capacity = 64 * 1024)
+      : os(os), buffer(capacity), used(0) {}
+
+    ~StreamWriter() { this->flush(); }
+
+    StreamWriter(const StreamWriter&) = delete;
+    StreamWriter& operator=(const StreamWriter&) = delete;
+
+    // A writer on the next len bytes of the output
+    ByteWriter next(size_t len) {
+      if (len > this->buffer.size() - this->used) this->flush();
+      if (len > this->buffer.size()) this->buffer.resize(len);
+      ByteWriter writer({this->buffer.data() + this->used, len});
+      this->used += len;
+      return writer;
+    }
+
+    void flush() {
+      if (this->used > 0) {
+        this->os.write(reinterpret_cast<const char*>(this->buffer.data()),
+                       static_cast<std::streamsize>(this->used));
+      }
+      this->used = 0;
+    }
+
+  private:
+    std::ostream &os;
+    std::vector<uint8_t> buffer;
+    size_t used;
+};
+
+/*
+ * Reads from an istream or a file descriptor the bytes asked by next(), and
+ * never more, so the input is left just after the object. The buffer only
+ * holds the current entry: it grows with the data actually received, and a
+ * reader returned by next() is valid until the following call.
+ */
+class StreamReader {
+  public:
+    explicit StreamReader(std::istream &is) : is(&is), fd(-1) {}
+    explicit StreamReader(int fd) : is(nullptr), fd(fd) {}
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    // The next len bytes, without consuming them
+    std::span<const uint8_t> peek(size_t len) {
+      this->fill(len);
+      return {this->buffer.data() + this->start, len};
+    }
+
+    uint8_t peek8() { return this->peek(1)[0]; }
+
+    // A reader on the next len bytes
+    ByteReader next(size_t len) {
+      auto bytes = this->peek(len);
+      this->start += len;
+      return ByteReader(bytes);
+    }
+
+    uint64_t getVarint() {
+      uint64_t value = 0;
+      for (unsigned shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = this->next(1).get8();
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+      }
+      throw std::runtime_error("Invalid varint");
+    }
+
+  private:
+    // Make len bytes available, reading only the missing ones
+    void fill(size_t len) {
+      size_t available = this->end - this->start;
+      if (available >= len) return;
+
+      if (this->start > 0) {
+        memmove(this->buffer.data(), this->buffer.data() + this->start, available);
+        this->start = 0;
+        this->end = available;
+      }
+
+      while (this->end < len) {
+        if (this->end == this->buffer.size()) {
+          this->buffer.resize(std::min(len, std::max<size_t>(2 * this->buffer.size(), 4096)));
+        }
+        size_t want = std::min(len, this->buffer.size()) - this->end;
+        this->end += this->read_some(this->buffer.data() + this->end, want);
+      }
+    }
+
+    size_t read_some(uint8_t *data, size_t len) {
+      if (this->is != nullptr) {
+        this->is->read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(len));
+        size_t nb_read = this->is->gcount();
+        if (nb_read == 0) throw std::out_of_range("Truncated input");
+        return nb_read;
+      }
+
+      ssize_t nb_read;
+      do {
+        nb_read = ::read(this->fd, data, len);
+      } while (nb_read < 0 && errno == EINTR);
+
+      if (nb_read < 0) throw std::runtime_error("Could not read input");
+      if (nb_read == 0) throw std::out_of_range("Truncated input");
+      return nb_read;
+    }
+
+    std::istream *is;
+    int fd;
+    std::vector<uint8_t> buffer;
+    size_t start = 0, end = 0;
+};
+
+#endif // __BYTE_STREAM_HPP__
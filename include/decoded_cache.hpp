@@ -0,0 +1,81 @@
+/**
+ * @file decoded_cache.hpp
+ * @brief Bounded cache of vectors decoded on demand
+ * @date 2024-06-13
+ *
+ */
+
+#ifndef __DECODED_CACHE_HPP__
+#define __DECODED_CACHE_HPP__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Least recently used cache of decoded vectors, indexed by name. The vectors
+ * are shared, so a vector evicted while a caller still uses it stays valid.
+ * With a capacity of 0 nothing is kept and every access decodes.
+ */
+template <class Vec>
+class DecodedCache {
+  public:
+    explicit DecodedCache(size_t capacity = 0) : capacity(capacity) {}
+
+    // The cached vectors are not copied, only the capacity
+    DecodedCache(const DecodedCache& other) : capacity(other.capacity) {}
+    DecodedCache& operator=(const DecodedCache& other) {
+      if (this != &other) this->reset(other.capacity);
+      return *this;
+    }
+
+    void reset(size_t capacity) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->entries.clear();
+      this->index.clear();
+      this->capacity = capacity;
+    }
+
+    void clear() { this->reset(this->capacity); }
+
+    // Return the vector of name, decode() is called on a miss
+    template <class Decode>
+    std::shared_ptr<const Vec> get(const std::string& name, Decode decode) {
+      if (this->capacity == 0) return decode();
+
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->index.find(name);
+        if (it != this->index.end()) {
+          this->entries.splice(this->entries.begin(), this->entries, it->second);
+          return it->second->second;
+        }
+      }
+
+      // Decode outside the lock, two threads may decode the same entry
+      std::shared_ptr<const Vec> vect = decode();
+
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->index.find(name) == this->index.end()) {
+        this->entries.emplace_front(name, vect);
+        this->index[name] = this->entries.begin();
+        if (this->entries.size() > this->capacity) {
+          this->index.erase(this->entries.back().first);
+          this->entries.pop_back();
+        }
+      }
+      return vect;
+    }
+
+  private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<const Vec>>> entries_t;
+
+    size_t capacity;
+    std::mutex mutex;
+    entries_t entries;
+    std::unordered_map<std::string, typename entries_t::iterator> index;
+};
+
+#endif // __DECODED_CACHE_HPP__
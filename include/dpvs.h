@@ -5,7 +5,7 @@
 extern "C" {
 #endif
 
-#include "matrix.h"
+#include "zp_matrix.h"
 
 typedef struct
 {
@@ -29,9 +29,20 @@ typedef struct
 #define G1_VS_BASE g1_vector_ptr* // Base of G1^dim vector space
 #define G2_VS_BASE g2_vector_ptr* // Base of G2^dim (dual space of G1^dim)
 
+/*
+ * Fixed-base tables used to lift the matrices entries in G1 and G2. When RELIC
+ * is built with EP_PRECO, g1_mul_gen/g2_mul_gen already use the precomputed
+ * tables of the curve generators and no table is allocated here.
+ */
+typedef struct
+{
+  g1_t* g1_table;
+  g2_t* g2_table;
+} dpvs_tables_t;
+
 /* Initialize a base implies initialisation matrix */
 #define dpvs_get_mat_row    mat_get_row
-#define dpvs_gen_matrices   mat_rand_dual_mat
+#define dpvs_gen_matrices   zp_mat_rand_dual_mat
 
 #ifdef __cplusplus
 }
@@ -45,6 +56,12 @@ G2_VS_BASE dpvs_create_g2_base(uint8_t dim);
 dpvs_t* dpvs_create_bases(uint8_t dim);
 dpvs_t* dpvs_generate_bases(uint8_t dim);
 
+/* Generation of the bases row by row, each row is an independent job */
+bool dpvs_tables_init(dpvs_tables_t* tables);
+void dpvs_tables_clear(dpvs_tables_t* tables);
+void dpvs_set_base_row(dpvs_t* dpvs, const mat_t mat, const dpvs_tables_t* tables, uint8_t i);
+void dpvs_set_dual_base_row(dpvs_t* dpvs, const mat_t dual_mat, const dpvs_tables_t* tables, uint8_t i);
+
 /* Compute the scalar multiplication of a vector */
 void dpvs_k_mul_g1_vect(g1_vector_ptr dest, const g1_vector_ptr src, const bn_t k);
 void dpvs_k_mul_g2_vect(g2_vector_ptr dest, const g2_vector_ptr src, const bn_t k);
@@ -64,8 +81,11 @@ static __inline__ void dpvs_inner_product(gt_t ip, const g1_vector_ptr vect, g2_
     pp_map_sim_oatep_k12(ip, vect->elements, dvect->elements, vect->dim);
 }
 
+/* Vectors, bases and dpvs_t are each allocated in a single block */
 void dpvs_clear_g1_vect(g1_vector_ptr bvect);
 void dpvs_clear_g2_vect(g2_vector_ptr dbvect);
+void dpvs_clear_g1_base(G1_VS_BASE base, uint8_t dim);
+void dpvs_clear_g2_base(G2_VS_BASE base, uint8_t dim);
 void dpvs_clear(dpvs_t* dpvs);
 
 #endif
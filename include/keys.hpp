@@ -14,13 +14,16 @@
 #include <iostream>
 #include <unistd.h>
 #include <fstream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <map>
 
 #include <abe_lsss/abe_lsss.h>
 
-#include "vector_ec.hpp"
+#include "vector_fixed.hpp"
+#include "decoded_cache.hpp"
+#include "policy_program.hpp"
 #include "serializer.hpp"
 
 extern "C" {
@@ -46,6 +49,9 @@ typedef enum KPABE_KEY_TYPE {
 
 #define hdrLen    (sizeof(uint8_t) + sizeof(uint32_t))
 
+// Entries buffered by a parallel deserialize in format v2 before decoding
+#define KPABE_DECODE_CHUNK    256
+
 class KPABE_DPVS_PUBLIC_KEY : public Serializer<KPABE_DPVS_PUBLIC_KEY> {
   public:
     KPABE_DPVS_PUBLIC_KEY() {};
@@ -55,31 +61,31 @@ class KPABE_DPVS_PUBLIC_KEY : public Serializer<KPABE_DPVS_PUBLIC_KEY> {
         this->loadFromFile(filename);
     };
 
-    ~KPABE_DPVS_PUBLIC_KEY() {};
-
     void set_bases(const G1_VS_BASE base_D, const G1_VS_BASE base_F,
                    const G1_VS_BASE base_G, const G1_VS_BASE base_H);
 
     // Getters
-    G1_VECTOR get_d1() const { return this->d1; }
-    G1_VECTOR get_d3() const { return this->d3; }
-    G1_VECTOR get_f1() const { return this->f1; }
-    G1_VECTOR get_f2() const { return this->f2; }
-    G1_VECTOR get_f3() const { return this->f3; }
-    G1_VECTOR get_g1() const { return this->g1; }
-    G1_VECTOR get_g2() const { return this->g2; }
-    G1_VECTOR get_h1() const { return this->h1; }
-    G1_VECTOR get_h2() const { return this->h2; }
-    G1_VECTOR get_h3() const { return this->h3; }
+    const G1Vec<ND>& get_d1() const { return this->d1; }
+    const G1Vec<ND>& get_d3() const { return this->d3; }
+    const G1Vec<NF>& get_f1() const { return this->f1; }
+    const G1Vec<NF>& get_f2() const { return this->f2; }
+    const G1Vec<NF>& get_f3() const { return this->f3; }
+    const G1Vec<NG>& get_g1() const { return this->g1; }
+    const G1Vec<NG>& get_g2() const { return this->g2; }
+    const G1Vec<NH>& get_h1() const { return this->h1; }
+    const G1Vec<NH>& get_h2() const { return this->h2; }
+    const G1Vec<NH>& get_h3() const { return this->h3; }
 
     void serialize(ByteString &result) const;
+    void serialize(ByteWriter &writer) const;
     void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
 
     void serialize(std::ostream& os) const {
       this->serializeToStream(os);
     }
-    void deserialize(std::istream& is) {
-      this->deserializeFromStream(is);
+    bool deserialize(std::istream& is) {
+      return this->deserializeFromStream(is);
     }
 
     void serialize(std::vector<uint8_t>& buffer) const {
@@ -88,6 +94,9 @@ class KPABE_DPVS_PUBLIC_KEY : public Serializer<KPABE_DPVS_PUBLIC_KEY> {
     void deserialize(const std::vector<uint8_t>& buffer) {
       this->deserializeFromBuffer(buffer);
     }
+    void deserialize(std::span<const uint8_t> buffer) {
+      this->deserializeFromSpan(buffer);
+    }
 
     size_t getSizeInBytes() const;
 
@@ -111,6 +120,9 @@ class KPABE_DPVS_PUBLIC_KEY : public Serializer<KPABE_DPVS_PUBLIC_KEY> {
     std::pair<KPABE_DPVS_PUBLIC_KEY, ZP> randomize() const;
 
     // Check that a public key is derived from the current key: k * this == other ?
+    // The points of other are checked to be in G1, then compared in a random
+    // combination with 128-bit scalars: a wrong key passes with probability
+    // at most 2^-127
     bool validate_derived_key(const KPABE_DPVS_PUBLIC_KEY& other, const ZP k) const;
 
     // operator==
@@ -122,10 +134,16 @@ class KPABE_DPVS_PUBLIC_KEY : public Serializer<KPABE_DPVS_PUBLIC_KEY> {
     }
 
   private:
-    G1_VECTOR d1, d3;
-    G1_VECTOR f1, f2, f3;
-    G1_VECTOR g1, g2;
-    G1_VECTOR h1, h2, h3;
+    // Store every vector in affine form
+    void normalize();
+
+    // Coordinates of the ten vectors, in a fixed order
+    void append_points(std::vector<const g1_t*> &points) const;
+
+    G1Vec<ND> d1, d3;
+    G1Vec<NF> f1, f2, f3;
+    G1Vec<NG> g1, g2;
+    G1Vec<NH> h1, h2, h3;
 };
 
 class KPABE_DPVS_MASTER_KEY : public Serializer<KPABE_DPVS_MASTER_KEY> {
@@ -137,31 +155,31 @@ class KPABE_DPVS_MASTER_KEY : public Serializer<KPABE_DPVS_MASTER_KEY> {
         this->loadFromFile(filename);
     };
 
-    ~KPABE_DPVS_MASTER_KEY() {};
-
     void set_bases(const G2_VS_BASE base_DD, const G2_VS_BASE base_FF,
                    const G2_VS_BASE base_GG, const G2_VS_BASE base_HH);
 
     // Getters
-    G2_VECTOR get_dd1() const { return this->dd1; }
-    G2_VECTOR get_dd3() const { return this->dd3; }
-    G2_VECTOR get_ff1() const { return this->ff1; }
-    G2_VECTOR get_ff2() const { return this->ff2; }
-    G2_VECTOR get_ff3() const { return this->ff3; }
-    G2_VECTOR get_gg1() const { return this->gg1; }
-    G2_VECTOR get_gg2() const { return this->gg2; }
-    G2_VECTOR get_hh1() const { return this->hh1; }
-    G2_VECTOR get_hh2() const { return this->hh2; }
-    G2_VECTOR get_hh3() const { return this->hh3; }
+    const G2Vec<ND>& get_dd1() const { return this->dd1; }
+    const G2Vec<ND>& get_dd3() const { return this->dd3; }
+    const G2Vec<NF>& get_ff1() const { return this->ff1; }
+    const G2Vec<NF>& get_ff2() const { return this->ff2; }
+    const G2Vec<NF>& get_ff3() const { return this->ff3; }
+    const G2Vec<NG>& get_gg1() const { return this->gg1; }
+    const G2Vec<NG>& get_gg2() const { return this->gg2; }
+    const G2Vec<NH>& get_hh1() const { return this->hh1; }
+    const G2Vec<NH>& get_hh2() const { return this->hh2; }
+    const G2Vec<NH>& get_hh3() const { return this->hh3; }
 
     void serialize(ByteString &result) const;
+    void serialize(ByteWriter &writer) const;
     void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
 
     void serialize(std::ostream& os) const {
       this->serializeToStream(os);
     }
-    void deserialize(std::istream& is) {
-      this->deserializeFromStream(is);
+    bool deserialize(std::istream& is) {
+      return this->deserializeFromStream(is);
     }
 
     void serialize(std::vector<uint8_t>& buffer) const {
@@ -170,6 +188,9 @@ class KPABE_DPVS_MASTER_KEY : public Serializer<KPABE_DPVS_MASTER_KEY> {
     void deserialize(const std::vector<uint8_t>& buffer) {
       this->deserializeFromBuffer(buffer);
     }
+    void deserialize(std::span<const uint8_t> buffer) {
+      this->deserializeFromSpan(buffer);
+    }
 
     size_t getSizeInBytes() const;
 
@@ -198,15 +219,20 @@ class KPABE_DPVS_MASTER_KEY : public Serializer<KPABE_DPVS_MASTER_KEY> {
     }
 
   private:
-    G2_VECTOR dd1, dd3;
-    G2_VECTOR ff1, ff2, ff3;
-    G2_VECTOR gg1, gg2;
-    G2_VECTOR hh1, hh2, hh3;
+    // Store every vector in affine form
+    void normalize();
+
+    G2Vec<ND> dd1, dd3;
+    G2Vec<NF> ff1, ff2, ff3;
+    G2Vec<NG> gg1, gg2;
+    G2Vec<NH> hh1, hh2, hh3;
 };
 
 class KPABE_DPVS_DECRYPTION_KEY : public Serializer<KPABE_DPVS_DECRYPTION_KEY> {
   public:
-    typedef std::map<std::string, G2_VECTOR> key_map_t;
+    typedef std::map<std::string, G2Vec<NF>> key_wl_map_t;
+    typedef std::map<std::string, G2Vec<NG>> key_bl_map_t;
+    typedef std::map<std::string, G2Vec<NH>> key_att_map_t;
 
     KPABE_DPVS_DECRYPTION_KEY() : policy(""), white_list({}), black_list({}), hash_attributes(false) {};
 
@@ -220,8 +246,6 @@ class KPABE_DPVS_DECRYPTION_KEY : public Serializer<KPABE_DPVS_DECRYPTION_KEY> {
                               const std::vector<std::string>& black_list,
                               bool hash_attr=false);
 
-    ~KPABE_DPVS_DECRYPTION_KEY() {};
-
     /*
      * This method generates the decryption key from the master key and the
      * policy, white list and black list
@@ -233,45 +257,77 @@ class KPABE_DPVS_DECRYPTION_KEY : public Serializer<KPABE_DPVS_DECRYPTION_KEY> {
               != this->black_list.end());
     }
 
-    std::string get_policy() const { return this->policy; }
+    const std::string& get_policy() const { return this->policy; }
+
+    // The policy compiled by generate or deserialize, empty if it is invalid
+    const PolicyProgram& get_policy_program() const { return this->program; }
 
     // Method returning key_root
-    G2_VECTOR get_key_root() const { return this->key_root; }
+    const G2Vec<ND>& get_key_root() const { return this->key_root; }
 
-    // Get element of map key_wl by key : key_wl[url]
-    std::optional<G2_VECTOR> get_key_wl(const std::string& url) const {
-      auto it = this->key_wl.find(url);
-      if (it != this->key_wl.end()) {
-        return it->second;
-      }
-      return std::nullopt;
-    }
+    /*
+     * With lazy decoding, the entries of key_wl and key_att read by deserialize
+     * are kept encoded and decoded on first access. Decoded entries are kept in
+     * a cache of cache_size entries per map, 0 decodes on every access.
+     * Disabling lazy decoding decodes the pending entries.
+     */
+    void set_lazy_decoding(bool lazy, size_t cache_size = 0);
 
-    // Get element of map ket_att by key : key_att[att]
-    std::optional<G2_VECTOR> get_key_att(const std::string& att) const {
-      auto it = this->key_att.find(att);
-      if (it != this->key_att.end()) {
-        return it->second;
-      }
-      return std::nullopt;
-    }
+    // Pending entries keep their encoding, they are decoded if it changes
+    void set_compression(bool compressed);
+    bool is_lazy_decoding() const { return this->lazy_decoding; }
+
+    /*
+     * With parallel decoding, deserialize first reads the entry boundaries and
+     * then decodes the points on the thread pool. A key in format v2 is read
+     * and decoded by chunks of KPABE_DECODE_CHUNK entries, so a streamed key
+     * is not buffered whole. Lazy decoding takes precedence for key_wl and
+     * key_att, whose encodings are then kept until they are used.
+     */
+    void set_parallel_decoding(bool parallel) { this->parallel_decoding = parallel; }
+    bool is_parallel_decoding() const { return this->parallel_decoding; }
+
+    /*
+     * deserialize checks that every point of the key is in G2, on the thread
+     * pool (see subgroup_check.hpp), and a lazy key checks each entry when it
+     * decodes it. Keys read from a trusted local cache can skip the check.
+     */
+    void set_validation(bool validate) { this->validate_points = validate; }
+    bool is_validating() const { return this->validate_points; }
+
+    // True if every decoded point of the key is in G2
+    bool is_valid() const;
+
+    // Get element of map key_wl by key : key_wl[url], nullptr if not found
+    std::shared_ptr<const G2Vec<NF>> get_key_wl(const std::string& url) const;
+
+    // Get element of map key_att by key : key_att[att], nullptr if not found
+    std::shared_ptr<const G2Vec<NH>> get_key_att(const std::string& att) const;
 
     // Methods to get an iterator to the beginning and end of the black list
-    key_map_t::const_iterator get_key_bl_begin() const {
+    key_bl_map_t::const_iterator get_key_bl_begin() const {
       return this->key_bl.begin();
     }
-    key_map_t::const_iterator get_key_bl_end() const {
+    key_bl_map_t::const_iterator get_key_bl_end() const {
       return this->key_bl.end();
     }
 
+    // Call f(url, key) for all entries of the black list
+    template <class F>
+    void for_each_key_bl(F f) const {
+      for (const auto& [url, key] : this->key_bl) f(url, key);
+    }
+
     void serialize(ByteString &result) const;
+    void serialize(ByteWriter &writer) const;
     void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
 
     void serialize(std::ostream& os) const {
       this->serializeToStream(os);
     }
-    void deserialize(std::istream& is) {
-      this->deserializeFromStream(is);
+    bool deserialize(std::istream& is) {
+      return this->deserializeFromStream(is);
     }
 
     void serialize(std::vector<uint8_t>& buffer) const {
@@ -280,9 +336,23 @@ class KPABE_DPVS_DECRYPTION_KEY : public Serializer<KPABE_DPVS_DECRYPTION_KEY> {
     void deserialize(const std::vector<uint8_t>& buffer) {
       this->deserializeFromBuffer(buffer);
     }
+    void deserialize(std::span<const uint8_t> buffer) {
+      this->deserializeFromSpan(buffer);
+    }
 
     size_t getSizeInBytes() const;
 
+    /*
+     * Format v2 (see serializer.hpp) has no limit on the number of entries,
+     * and is written to a stream entry by entry. deserialize reads both.
+     */
+    size_t getSizeInBytesV2() const;
+    void serializeV2(std::ostream& os) const;
+    void serializeV2(std::vector<uint8_t>& buffer) const;
+
+    // Decode format v2 entry by entry, holding one entry at a time
+    void deserialize(StreamReader &reader);
+
     void saveToFile(const std::string& filename) const {
       std::ofstream ofs(filename, std::ios::binary);
       if (ofs.is_open()) {
@@ -303,15 +373,43 @@ class KPABE_DPVS_DECRYPTION_KEY : public Serializer<KPABE_DPVS_DECRYPTION_KEY> {
     bool operator==(const KPABE_DPVS_DECRYPTION_KEY& other) const;
 
   private:
+    friend class KPABE_DPVS_MAPPED_DECRYPTION_KEY;
+
+    // Store every vector in affine form
+    void normalize();
+
     std::string policy;
+    PolicyProgram program;
     std::vector<std::string> white_list;
     std::vector<std::string> black_list;
     bool hash_attributes;
 
-    G2_VECTOR key_root;   // D*
-    key_map_t key_wl;     // F*
-    key_map_t key_bl;     // G*
-    key_map_t key_att;    // H*
+    G2Vec<ND> key_root;       // D*
+    key_wl_map_t key_wl;      // F*
+    key_bl_map_t key_bl;      // G*
+    key_att_map_t key_att;    // H*
+
+    // Entries of key_wl and key_att not decoded yet, see set_lazy_decoding
+    void decode_pending(const std::map<std::string, size_t>& encoded_bl = {});
+    void clear_pending();
+    bool has_pending() const { return !this->encoded_wl.empty() || !this->encoded_att.empty(); }
+    template <class Vec> size_t keep_encoded(ByteReader &reader);
+    template <class Vec> size_t keep_points(ByteReader &points);
+
+    template <class Sink> void encodeV2(Sink &sink) const;
+    template <class Source> void decodeV2(Source &source);
+
+    // Throw if validation is enabled and a point is not in G2
+    void check_points() const;
+
+    bool lazy_decoding = false;
+    bool parallel_decoding = false;
+    bool validate_points = true;
+    std::vector<uint8_t> encoded;             // encoded vectors
+    std::map<std::string, size_t> encoded_wl; // url -> offset in encoded
+    std::map<std::string, size_t> encoded_att; // att -> offset in encoded
+    mutable DecodedCache<G2Vec<NF>> wl_cache;
+    mutable DecodedCache<G2Vec<NH>> att_cache;
 };
 
 bool getSizeFromStream(std::istream &is, size_t *size, ByteString &size_buf);
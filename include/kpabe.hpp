@@ -16,14 +16,20 @@
 #include <map>
 
 #include "keys.hpp"
+#include "mapped_key.hpp"
+#include "attribute_table.hpp"
 
 
-#define KPABE_CIPHERTEXT_TYPE   0xFF
+#define KPABE_CIPHERTEXT_TYPE           0xFF
+#define KPABE_CIPHERTEXT_COMPACT_TYPE   0xFE
+
+#define KPABE_URL_DIGEST_LEN    RLC_MD_LEN_SH256
+#define KPABE_ATT_ID_LEN        sizeof(uint64_t)
 
 // Ciphertext class
 class KPABE_DPVS_CIPHERTEXT : public Serializer<KPABE_DPVS_CIPHERTEXT> {
   public:
-    typedef std::map<std::string, G1_VECTOR> ctx_map_t;
+    typedef AttributeTable<G1Vec<NH>> ctx_table_t;
 
     KPABE_DPVS_CIPHERTEXT() : attributes(""), url(""), hash_attributes(false) {};
 
@@ -39,33 +45,30 @@ class KPABE_DPVS_CIPHERTEXT : public Serializer<KPABE_DPVS_CIPHERTEXT> {
         this->loadFromFile(filename);
     };
 
-    ~KPABE_DPVS_CIPHERTEXT() {};
-
     // Setters for attributes and url
     void set_attributes(const std::string& attributes);
     void set_url(const std::string& url);
 
     // Getters for G1 vectors members
-    G1_VECTOR get_ctx_root() const { return this->ctx_root; }
-    G1_VECTOR get_ctx_wl() const { return this->ctx_wl; }
-    G1_VECTOR get_ctx_bl() const { return this->ctx_bl; }
-
-    // Get element of map ctx_att by key : ctx_att[att]
-    std::optional<G1_VECTOR> get_ctx_att(const std::string& att) const {
-      auto it = this->ctx_att.find(att);
-      if (it != this->ctx_att.end()) {
-        return it->second;
-      }
-      return std::nullopt;
+    const G1Vec<ND>& get_ctx_root() const { return this->ctx_root; }
+    const G1Vec<NF>& get_ctx_wl() const { return this->ctx_wl; }
+    const G1Vec<NG>& get_ctx_bl() const { return this->ctx_bl; }
+
+    // Get element of ctx_att by key : ctx_att[att], nullptr if not found
+    const G1Vec<NH>* get_ctx_att(const std::string& att) const {
+      size_t row = this->ctx_att.find(att);
+      return (row != this->ctx_att.size()) ? &this->ctx_att.get_rows()[row] : nullptr;
     }
 
     // session_key is the output : it must be allocated before calling this method
     bool encrypt(uint8_t* session_key, const KPABE_DPVS_PUBLIC_KEY& public_key);
 
-    bool decrypt(uint8_t* session_key,
-                 const KPABE_DPVS_DECRYPTION_KEY& dec_key, ZP &randomizer) const;
+    // DecKey is KPABE_DPVS_DECRYPTION_KEY or KPABE_DPVS_MAPPED_DECRYPTION_KEY
+    template <class DecKey>
+    bool decrypt(uint8_t* session_key, const DecKey& dec_key, ZP &randomizer) const;
 
-    bool decrypt(uint8_t* session_key, const KPABE_DPVS_DECRYPTION_KEY& dec_key) const {
+    template <class DecKey>
+    bool decrypt(uint8_t* session_key, const DecKey& dec_key) const {
       ZP randomizer;
       return this->decrypt(session_key, dec_key, randomizer);
     }
@@ -73,16 +76,29 @@ class KPABE_DPVS_CIPHERTEXT : public Serializer<KPABE_DPVS_CIPHERTEXT> {
     // Remove k from the ciphertext : this = this * inverse(k)
     void remove_scalar(const ZP& k);
 
+    /*
+     * deserialize checks that every point of the ciphertext is in G1, on the
+     * thread pool (see subgroup_check.hpp). Ciphertexts read from a trusted
+     * local cache can skip the check.
+     */
+    void set_validation(bool validate) { this->validate_points = validate; }
+    bool is_validating() const { return this->validate_points; }
+
+    // True if every point of the ciphertext is in G1
+    bool is_valid() const;
+
     size_t getSizeInBytes() const;
 
     void serialize(ByteString &result) const;
+    void serialize(ByteWriter &writer) const;
     void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
 
     void serialize(std::ostream& os) const {
       this->serializeToStream(os);
     }
-    void deserialize(std::istream& is) {
-      this->deserializeFromStream(is);
+    bool deserialize(std::istream& is) {
+      return this->deserializeFromStream(is);
     }
 
     void serialize(std::vector<uint8_t>& bytes) const {
@@ -91,6 +107,28 @@ class KPABE_DPVS_CIPHERTEXT : public Serializer<KPABE_DPVS_CIPHERTEXT> {
     void deserialize(const std::vector<uint8_t>& bytes) {
       this->deserializeFromBuffer(bytes);
     }
+    void deserialize(std::span<const uint8_t> bytes) {
+      this->deserializeFromSpan(bytes);
+    }
+
+    // Format v2 (see serializer.hpp), deserialize reads both formats
+    size_t getSizeInBytesV2() const;
+    void serializeV2(std::ostream& os) const;
+    void serializeV2(std::vector<uint8_t>& bytes) const;
+    void deserialize(StreamReader &reader);
+
+    /*
+     * Compact format, for ciphertexts sent with each response: the url is
+     * replaced by its SHA-256 digest and the attributes by 8 bytes ids, the
+     * dimensions are written once and the points follow without headers.
+     * The receiver knows the url, and gives the attribute names it can use
+     * (e.g. those of its policy); the other attributes are dropped.
+     */
+    size_t getCompactSizeInBytes() const;
+    void serializeCompact(ByteWriter &writer) const;
+    void serializeCompact(std::vector<uint8_t>& bytes) const;
+    bool deserializeCompact(std::span<const uint8_t> bytes, const std::string& url,
+                            const std::vector<std::string>& attributes);
 
     void saveToFile(const std::string& filename) const {
       std::ofstream ofs(filename, std::ios::binary);
@@ -109,14 +147,24 @@ class KPABE_DPVS_CIPHERTEXT : public Serializer<KPABE_DPVS_CIPHERTEXT> {
     }
 
   private:
+    // Store every vector in affine form
+    void normalize();
+
+    template <class Sink> void encodeV2(Sink &sink) const;
+    template <class Source> void decodeV2(Source &source);
+
+    // Throw if validation is enabled and a point is not in G1
+    void check_points() const;
+
     std::string attributes;
     std::string url;
     bool hash_attributes;
+    bool validate_points = true;
 
-    G1_VECTOR ctx_root;   // D
-    G1_VECTOR ctx_wl;     // F
-    G1_VECTOR ctx_bl;     // G
-    ctx_map_t ctx_att;    // H
+    G1Vec<ND> ctx_root;   // D
+    G1Vec<NF> ctx_wl;     // F
+    G1Vec<NG> ctx_bl;     // G
+    ctx_table_t ctx_att;  // H, one row per attribute
 };
 
 
@@ -128,8 +176,6 @@ class KPABE_DPVS {
     KPABE_DPVS(const std::vector<std::string>& white_list,
                const std::vector<std::string>& black_list);
 
-    ~KPABE_DPVS() {};
-
     // Setup : generate public and master keys
     bool setup();
 
@@ -149,10 +195,10 @@ class KPABE_DPVS {
                               bool hash_attr = false) const;
 
     // Getter for public key
-    KPABE_DPVS_PUBLIC_KEY get_public_key() const { return this->public_key; }
+    const KPABE_DPVS_PUBLIC_KEY& get_public_key() const { return this->public_key; }
 
     // Getter for master key
-    KPABE_DPVS_MASTER_KEY get_master_key() const { return this->master_key; }
+    const KPABE_DPVS_MASTER_KEY& get_master_key() const { return this->master_key; }
 
     // Export public key to file
     void export_public_key(const std::string& filename) const {
@@ -0,0 +1,116 @@
+/**
+ * @file mapped_key.hpp
+ * @brief Decryption key stored in a file mapped in memory
+ * @date 2024-06-11
+ *
+ */
+
+#ifndef __MAPPED_KEY_HPP__
+#define __MAPPED_KEY_HPP__
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "keys.hpp"
+
+#define KPABE_MAPPED_KEY_MAGIC      "KPDK"
+#define KPABE_MAPPED_KEY_VERSION    1
+
+/*
+ * File layout (integers are big-endian):
+ *
+ *   header   magic[4] version:u16 point_size:u16 nb_wl:u32 nb_bl:u32 nb_att:u32
+ *            policy_len:u32 policy_offset:u64 index_offset:u64 names_offset:u64
+ *            records_offset:u64 file_size:u64
+ *   policy   policy_len bytes
+ *   index    nb_wl + nb_bl + nb_att entries: hash:u64 name_offset:u64 name_len:u32
+ *            reserved:u32. The entries of each list are sorted by hash.
+ *   names    the URLs and attribute keys, referenced by the index
+ *   records  key_root, then the vectors of the white list, black list and
+ *            attributes, in the order of the index: ND, NF, NG or NH points of
+ *            point_size bytes each, compressed or not as the written key.
+ *
+ * The file is mapped read-only, so processes opening the same key share the
+ * page cache. A lookup is a binary search in the index, and only the vectors
+ * used by a decryption are decoded. The black list is the exception: every
+ * decryption goes through all of it, so it is decoded once, at open, as the
+ * policy is compiled once.
+ */
+class KPABE_DPVS_MAPPED_DECRYPTION_KEY {
+  public:
+    KPABE_DPVS_MAPPED_DECRYPTION_KEY() = default;
+
+    explicit KPABE_DPVS_MAPPED_DECRYPTION_KEY(const std::string& filename) {
+      this->open(filename);
+    }
+
+    ~KPABE_DPVS_MAPPED_DECRYPTION_KEY() { this->close(); }
+
+    KPABE_DPVS_MAPPED_DECRYPTION_KEY(const KPABE_DPVS_MAPPED_DECRYPTION_KEY&) = delete;
+    KPABE_DPVS_MAPPED_DECRYPTION_KEY& operator=(const KPABE_DPVS_MAPPED_DECRYPTION_KEY&) = delete;
+
+    KPABE_DPVS_MAPPED_DECRYPTION_KEY(KPABE_DPVS_MAPPED_DECRYPTION_KEY&& other) noexcept {
+      *this = std::move(other);
+    }
+    KPABE_DPVS_MAPPED_DECRYPTION_KEY& operator=(KPABE_DPVS_MAPPED_DECRYPTION_KEY&& other) noexcept;
+
+    // Write dec_key in the mapped format, the file is replaced atomically
+    static bool write(const KPABE_DPVS_DECRYPTION_KEY& dec_key, const std::string& filename);
+
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return this->base != nullptr; }
+
+    const std::string& get_policy() const { return this->policy; }
+
+    // The policy compiled at open
+    const PolicyProgram& get_policy_program() const { return this->program; }
+
+    bool is_in_black_list(const std::string& url) const {
+      return this->find(this->bl_index, this->nb_bl, url).has_value();
+    }
+
+    G2Vec<ND> get_key_root() const;
+
+    // Decode the vector of url in the white list, if any
+    std::optional<G2Vec<NF>> get_key_wl(const std::string& url) const;
+
+    // Decode the vector of the attribute att, if any
+    std::optional<G2Vec<NH>> get_key_att(const std::string& att) const;
+
+    size_t get_nb_key_bl() const { return this->key_bl.size(); }
+    const std::string& get_key_bl_name(size_t i) const { return this->key_bl.at(i).first; }
+    const G2Vec<NG>& get_key_bl(size_t i) const { return this->key_bl.at(i).second; }
+
+    // Call f(url, key) for all entries of the black list
+    template <class F>
+    void for_each_key_bl(F f) const {
+      for (const auto& [url, key] : this->key_bl) f(url, key);
+    }
+
+  private:
+    std::optional<size_t> find(const uint8_t *index, size_t size, const std::string& name) const;
+    std::string get_name(const uint8_t *entry) const;
+    const uint8_t* get_record(size_t nb_points) const;
+
+    template <class Vec>
+    Vec decode(const uint8_t *record) const;
+
+    uint8_t *base = nullptr;
+    size_t length = 0;
+
+    std::string policy;
+    PolicyProgram program;
+    size_t point_size = 0;
+    size_t nb_wl = 0, nb_bl = 0, nb_att = 0;
+    const uint8_t *wl_index = nullptr, *bl_index = nullptr, *att_index = nullptr;
+    const uint8_t *names = nullptr;
+    size_t names_size = 0;
+    const uint8_t *records = nullptr;
+
+    std::vector<std::pair<std::string, G2Vec<NG>>> key_bl;   // decoded at open
+};
+
+#endif // __MAPPED_KEY_HPP__
@@ -0,0 +1,45 @@
+/**
+ * @file md_batch.hpp
+ * @brief Hash of many short strings at once (multi-buffer SHA-256)
+ * @date 2024-07-04
+ *
+ */
+
+#ifndef __MD_BATCH_HPP__
+#define __MD_BATCH_HPP__
+
+#include <array>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <relic/relic.h>
+}
+
+// Smallest batch given to the SIMD kernels, smaller ones use md_map
+#define KPABE_MD_BATCH_MIN    4
+
+typedef std::array<uint8_t, RLC_MD_LEN> md_digest_t;
+
+/*
+ * digests[i] = md_map(inputs[i]). When RELIC hashes with SHA-256, the strings
+ * are hashed 16 at a time with AVX-512 or 8 at a time with AVX2, one string
+ * per 32-bit lane. The kernel is chosen once, from the cpu running the
+ * process, unless md_batch_set_method forces it. Strings are sorted by number of blocks, so that the lanes of a
+ * group finish together. Other hash functions and other cpus use md_map.
+ */
+void md_map_batch(std::vector<md_digest_t> &digests,
+                  const std::vector<std::string> &inputs);
+
+// Kernel used by md_map_batch: "avx512", "avx2" or "scalar"
+const char* md_batch_method();
+
+/*
+ * Force the kernel of md_map_batch, for the whole process: "avx512", "avx2",
+ * "scalar", or "auto" to choose it from the cpu again. False if the kernel is
+ * unknown or not supported by the cpu, the kernel is then unchanged. Tests use
+ * it to run every kernel the machine has.
+ */
+bool md_batch_set_method(const std::string &method);
+
+#endif // __MD_BATCH_HPP__
@@ -0,0 +1,89 @@
+/**
+ * @file policy_program.hpp
+ * @brief Policies compiled to a flat program over interned attribute ids
+ * @date 2024-07-01
+ *
+ */
+
+#ifndef __POLICY_PROGRAM_HPP__
+#define __POLICY_PROGRAM_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <abe_lsss/abe_lsss.h>
+
+#include "attribute_interner.hpp"
+
+/*
+ * Set of attributes of a ciphertext, one bit per id of the global interner.
+ * The names come from the ciphertext: they are looked up, not interned, and
+ * names which are not interned are skipped. A compiled policy has interned
+ * all its labels, so a skipped name matches no leaf.
+ */
+class AttributeSet {
+  public:
+    AttributeSet() = default;
+
+    // Attributes of a list in the OpenABE format ("A|B|C")
+    explicit AttributeSet(const std::string &attributes);
+    explicit AttributeSet(const std::vector<std::string> &attributes);
+
+    void insert(attribute_id_t id) {
+      if ((id >> 6) >= this->words.size()) this->words.resize((id >> 6) + 1, 0);
+      this->words[id >> 6] |= (uint64_t)1 << (id & 63);
+    }
+
+    bool contains(attribute_id_t id) const {
+      return (id >> 6) < this->words.size() &&
+             ((this->words[id >> 6] >> (id & 63)) & 1);
+    }
+
+  private:
+    std::vector<uint64_t> words;
+};
+
+/*
+ * A key policy compiled once, then evaluated against many ciphertexts without
+ * parsing it again. The tree is flattened in postorder (children before their
+ * gate, the root last). Every gate is a threshold: AND is n-of-n, OR is 1-of-n.
+ * Leaves hold the interned id of their complete label, which is the name of
+ * the matching attribute of a ciphertext.
+ *
+ * select gives the attributes of a satisfying set with the fewest leaves: the
+ * LSSS is then built on those attributes only, one row (and one pairing) per
+ * attribute needed by the decryption.
+ */
+class PolicyProgram {
+  public:
+    PolicyProgram() = default;
+    explicit PolicyProgram(const std::string &policy) { this->compile(policy); }
+
+    // Replace the program, false if the policy cannot be parsed
+    bool compile(const std::string &policy);
+    bool compile(OpenABEPolicy &policy);
+
+    bool empty() const { return this->nodes.empty(); }
+
+    bool is_satisfied(const AttributeSet &attributes) const;
+
+    // Ids of a smallest satisfying set of leaves, false if not satisfied
+    bool select(const AttributeSet &attributes,
+                std::vector<attribute_id_t> &selected) const;
+
+  private:
+    struct Node {
+      attribute_id_t id;    // leaf only
+      uint32_t threshold;   // gate only
+      uint32_t first;       // gate only, first child in children
+      uint32_t count;       // number of children, 0 for a leaf
+    };
+
+    bool compile_node(OpenABETreeNode *node, AttributeInterner &interner);
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> children;
+};
+
+#endif // __POLICY_PROGRAM_HPP__
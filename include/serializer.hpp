@@ -4,56 +4,192 @@
 #include <abe_lsss/abe_lsss.h>
 #include <iostream>
 #include <fstream>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
 #include <vector>
 
+#include "byte_stream.hpp"
+
 
 using ByteString = OpenABEByteString;
 
 bool getSizeFromStream(std::istream &is, size_t *size, ByteString &size_buf);
 
+// Counts of format v1 are 16 bits, larger objects need format v2
+inline uint16_t count_v1(size_t count) {
+  if (count > UINT16_MAX) {
+    throw std::length_error("Too many entries for format v1, use format v2");
+  }
+  return count;
+}
+
+/*
+ * Format v2 : KPABE_FORMAT_V2, object type, point encoding (1 if compressed),
+ * the dimensions of the vectors, then the content where lengths and counts are
+ * varints and vectors are their bare points. It is written and read entry by
+ * entry through a Sink (ByteWriter, StreamWriter) or a Source (ByteReader).
+ * The first byte differs from BYTESTRING, which starts format v1.
+ */
+#define KPABE_FORMAT_V2   0xB2
+
+template <class Sink>
+void put_header_v2(Sink &sink, uint8_t type, bool compressed,
+                   std::initializer_list<uint64_t> dims) {
+  size_t len = 3;
+  for (uint64_t dim : dims) len += varint_size(dim);
+
+  ByteWriter writer = sink.next(len);
+  writer.put8(KPABE_FORMAT_V2);
+  writer.put8(type);
+  writer.put8(compressed);
+  for (uint64_t dim : dims) writer.putVarint(dim);
+}
+
+// Return false if the header is not the one of type with these dimensions
+template <class Source>
+bool get_header_v2(Source &source, uint8_t type, bool *compressed,
+                   std::initializer_list<uint64_t> dims) {
+  ByteReader header = source.next(3);
+  if (header.get8() != KPABE_FORMAT_V2 || header.get8() != type) return false;
+
+  uint8_t encoding = header.get8();
+  if (encoding > 1) return false;
+  *compressed = (encoding == 1);
+
+  for (uint64_t dim : dims) {
+    if (source.getVarint() != dim) return false;
+  }
+  return true;
+}
+
+template <class Sink>
+void put_count_v2(Sink &sink, uint64_t count) {
+  ByteWriter writer = sink.next(varint_size(count));
+  writer.putVarint(count);
+}
+
+// Write name, and return a writer on the points_size bytes which follow it
+template <class Sink>
+ByteWriter next_entry_v2(Sink &sink, const std::string &name, size_t points_size) {
+  ByteWriter writer = sink.next(varint_size(name.size()) + name.size() + points_size);
+  writer.putVarint(name.size());
+  writer.putBytes(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+  return writer;
+}
+
+inline size_t entry_size_v2(const std::string &name, size_t points_size) {
+  return varint_size(name.size()) + name.size() + points_size;
+}
+
+template <class Source>
+std::string get_string_v2(Source &source) {
+  uint64_t len = source.getVarint();
+  ByteReader reader = source.next(len);
+  return std::string(reinterpret_cast<const char*>(reader.advance(len)), len);
+}
+
 template <class T>
 class Serializer {
   public:
+    /*
+     * Points are written compressed by default (BIN_COMPRESSED). Uncompressed
+     * points take twice the space but load faster, which suits local caches.
+     * The choice is recorded in the output and restored by deserialization.
+     */
+    void set_compression(bool compressed) { this->compressed = compressed; }
+    bool is_compressed() const { return this->compressed; }
+
+    /*
+     * Write the object in output, which must hold at least getSizeInBytes()
+     * bytes, and return the number of bytes written.
+     */
+    size_t serializeToSpan(std::span<uint8_t> output) const {
+      const T* object = static_cast<const T*>(this);
+      size_t size = object->getSizeInBytes();
+      if (output.size() < size) {
+        throw std::length_error("Output buffer is too small");
+      }
+
+      ByteWriter writer(output.first(size));
+      object->serialize(writer);
+      if (writer.size() != size) {
+        throw std::logic_error("Serialized size differs from getSizeInBytes");
+      }
+      return size;
+    }
+
     void serializeToBuffer(std::vector<uint8_t> &buffer) const {
-      ByteString temp;
-      static_cast<const T*>(this)->serialize(temp);
-      buffer.resize(temp.size());
-      std::copy(temp.data(), temp.data() + temp.size(), buffer.begin());
+      buffer.resize(static_cast<const T*>(this)->getSizeInBytes());
+      this->serializeToSpan(buffer);
+    }
+
+    // Parse the object in place, without copying the input
+    void deserializeFromSpan(std::span<const uint8_t> input) {
+      ByteReader reader(input);
+      static_cast<T*>(this)->deserialize(reader);
     }
 
     void deserializeFromBuffer(const std::vector<uint8_t> &buffer) {
-      ByteString temp;
-      temp.fillBuffer(0, buffer.size());
-      std::copy(buffer.begin(), buffer.end(), temp.data());
-      static_cast<T*>(this)->deserialize(temp);
+      this->deserializeFromSpan(buffer);
     }
 
     void serializeToStream(std::ostream& os) const {
-      ByteString temp;
-      static_cast<const T*>(this)->serialize(temp);
-      os.write(reinterpret_cast<const char*>(temp.data()), static_cast<std::streamsize>(temp.size()));
+      std::vector<uint8_t> buffer;
+      this->serializeToBuffer(buffer);
+      os.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
     }
 
-    void deserializeFromStream(std::istream& is) {
-      if (is.good()) {
-        ByteString temp, bytes;
-        size_t size = 0;
+    /*
+     * Read the object from a stream, up to its end and no further. Format v2
+     * is decoded entry by entry while the bytes arrive, format v1 is read in
+     * one buffer whose size is given by its header. Truncated or malformed
+     * input is reported on cerr and gives false, from a stream or a fd alike.
+     */
+    bool deserializeFromStream(std::istream& is) {
+      if (!is.good()) return false;
+      StreamReader reader(is);
+      return this->tryDeserializeFromReader(reader);
+    }
 
-        if (!getSizeFromStream(is, &size, bytes)) {
-          std::cerr << "Error: Could not get size from stream" << std::endl;
-          return;
-        }
+    bool deserializeFromFd(int fd) {
+      StreamReader reader(fd);
+      return this->tryDeserializeFromReader(reader);
+    }
 
-        temp.fillBuffer(0, size);
-        is.read(reinterpret_cast<char*>(temp.getInternalPtr()), static_cast<std::streamsize>(size));
-        if (!is.good()) {
-          std::cerr << "Error: Could not read data" << std::endl;
+    void deserializeFromReader(StreamReader &reader) {
+      T* object = static_cast<T*>(this);
+      if (reader.peek8() == KPABE_FORMAT_V2) {
+        if constexpr (requires { object->deserialize(reader); }) {
+          object->deserialize(reader);
           return;
+        } else {
+          throw std::runtime_error("Format v2 is not supported for this object");
         }
+      }
+
+      ByteReader header(reader.peek(sizeof(uint8_t) + sizeof(uint32_t)));
+      header.get8();
+      size_t size = header.get32();
+
+      ByteReader content = reader.next(header.position() + size);
+      object->deserialize(content);
+    }
+
+  protected:
+    bool compressed = BIN_COMPRESSED;
 
-        bytes += temp;
-        static_cast<T*>(this)->deserialize(bytes);
+  private:
+    bool tryDeserializeFromReader(StreamReader &reader) {
+      try {
+        this->deserializeFromReader(reader);
+        return true;
+      } catch (const std::out_of_range&) {
+        std::cerr << "Error: Could not read data, the input is truncated" << std::endl;
+      } catch (const std::runtime_error& e) {
+        std::cerr << "Error: Could not read data: " << e.what() << std::endl;
       }
+      return false;
     }
 };
 
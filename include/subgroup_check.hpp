@@ -0,0 +1,57 @@
+/**
+ * @file subgroup_check.hpp
+ * @brief Subgroup membership of many G1/G2 points
+ * @date 2024-06-20
+ *
+ */
+
+#ifndef __SUBGROUP_CHECK_HPP__
+#define __SUBGROUP_CHECK_HPP__
+
+#include <vector>
+
+#include "vector_fixed.hpp"
+
+/*
+ * Subgroup membership of the points of many vectors, spread over the thread
+ * pool. Each point is checked alone, with the endomorphism-based test of
+ * RELIC (g1_is_valid, g2_is_valid). A random linear combination of the points
+ * is not used: a point outside the subgroup passes it with probability 1/q,
+ * q being the smallest prime factor of the cofactor, and the cofactor of G1
+ * on BLS12-381 has the factor 3.
+ *
+ * The points are referenced, not copied: the vectors must outlive the batch.
+ */
+class G1SubgroupBatch {
+  public:
+    template <size_t N>
+    void add(const G1Vec<N> &vect) {
+      for (size_t i = 0; i < N; i++) this->points.push_back(&vect.data()[i]);
+    }
+
+    size_t size() const { return this->points.size(); }
+
+    // True if every point is in G1 (the point at infinity is)
+    bool verify() const;
+
+  private:
+    std::vector<const g1_t*> points;
+};
+
+class G2SubgroupBatch {
+  public:
+    template <size_t N>
+    void add(const G2Vec<N> &vect) {
+      for (size_t i = 0; i < N; i++) this->points.push_back(&vect.data()[i]);
+    }
+
+    size_t size() const { return this->points.size(); }
+
+    // True if every point is in G2 (the point at infinity is)
+    bool verify() const;
+
+  private:
+    std::vector<const g2_t*> points;
+};
+
+#endif // __SUBGROUP_CHECK_HPP__
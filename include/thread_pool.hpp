@@ -0,0 +1,63 @@
+/**
+ * @file thread_pool.hpp
+ * @brief Pool of worker threads able to run RELIC operations
+ * @date 2024-05-21
+ *
+ */
+
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Each worker owns a RELIC context, initialized with the same pairing
+ * parameters as the thread creating the pool. This requires RELIC to be built
+ * with MULTI=PTHREAD: otherwise the pool has no worker and every job runs in
+ * the calling thread.
+ */
+class ThreadPool {
+  public:
+    explicit ThreadPool(size_t nb_workers);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of worker threads (the calling thread also runs jobs)
+    size_t size() const { return this->workers.size(); }
+
+    // Run job(i) for all i in [0, n) and wait for completion
+    void parallel_for(size_t n, const std::function<void(size_t)>& job);
+
+    // Pool shared by the library, one worker per hardware thread
+    static ThreadPool& global();
+
+  private:
+    void worker_loop(int param);
+    void run_jobs();
+
+    std::vector<std::thread> workers;
+
+    std::mutex batch_mutex;   // one parallel_for at a time
+    std::mutex mutex;
+    std::condition_variable cv_job, cv_done;
+
+    const std::function<void(size_t)>* job = nullptr;
+    size_t job_size = 0;
+    std::atomic<size_t> next_job{0};
+    size_t active = 0;
+    size_t ready = 0;
+    size_t failed = 0;
+    uint64_t generation = 0;
+    bool stop = false;
+    std::exception_ptr error;
+};
+
+#endif // __THREAD_POOL_HPP__
@@ -1,6 +1,8 @@
 #ifndef __VECTOR_EC_H__
 #define __VECTOR_EC_H__
 
+#include <array>
+#include <span>
 #include <vector>
 #include <abe_lsss/abe_lsss.h>
 
@@ -20,6 +22,8 @@ extern "C" {
 typedef enum ElementType {
   VECTOR_G1_ELEMENT = 0xF1,
   VECTOR_G2_ELEMENT = 0xF2,
+  VECTOR_G1_ELEMENT_UNCOMPRESSED = 0xE1,
+  VECTOR_G2_ELEMENT_UNCOMPRESSED = 0xE2,
 } ElementType;
 
 using ByteString = OpenABEByteString;
@@ -30,10 +34,11 @@ private:
   bool isDimSet;
 
 public:
-  G1_VECTOR() : std::vector<G1>(), ZObject(), isDimSet(false) {}
+  G1_VECTOR() : std::vector<G1>(), ZObject(), dim(0), isDimSet(false) {}
   G1_VECTOR(size_t dim) : std::vector<G1>(dim), ZObject(), dim(dim), isDimSet(true) {}
-  G1_VECTOR(std::initializer_list<G1> init_list) : std::vector<G1>(init_list), ZObject(), isDimSet(false) {}
+  G1_VECTOR(std::initializer_list<G1> init_list) : std::vector<G1>(init_list), ZObject(), dim(0), isDimSet(false) {}
   G1_VECTOR(const G1_VECTOR &other) : std::vector<G1>(other), ZObject(), dim(other.dim), isDimSet(other.isDimSet) {}
+  G1_VECTOR(G1_VECTOR &&other) noexcept : std::vector<G1>(std::move(other)), ZObject(), dim(other.dim), isDimSet(other.isDimSet) {}
   G1_VECTOR(const g1_vector_ptr &g1_vector);
 
   ~G1_VECTOR() { this->clear(); this->dim = 0; this->isDimSet = false; }
@@ -60,8 +65,11 @@ public:
 
   bool operator==(const G1_VECTOR &x) const;
   G1_VECTOR& operator=(const G1_VECTOR &other);
+  G1_VECTOR& operator=(G1_VECTOR &&other) noexcept;
   G1_VECTOR  operator+(const G1_VECTOR &other) const;
   G1_VECTOR  operator*(const ZP &k) const;
+  G1_VECTOR& operator+=(const G1_VECTOR &other);
+  G1_VECTOR& operator*=(const ZP &k);
 
   // Temporary methods for testing, will be removed later
   void random(size_t dim) {
@@ -82,10 +90,11 @@ private:
   bool isDimSet;
 
 public:
-  G2_VECTOR() : std::vector<G2>(), isDimSet(false) {}
+  G2_VECTOR() : std::vector<G2>(), dim(0), isDimSet(false) {}
   G2_VECTOR(size_t dim) : std::vector<G2>(dim), dim(dim), isDimSet(true) {}
-  G2_VECTOR(std::initializer_list<G2> init_list) : std::vector<G2>(init_list), isDimSet(false) {}
+  G2_VECTOR(std::initializer_list<G2> init_list) : std::vector<G2>(init_list), dim(0), isDimSet(false) {}
   G2_VECTOR(const G2_VECTOR &other) : std::vector<G2>(other), dim(other.dim), isDimSet(other.isDimSet) {}
+  G2_VECTOR(G2_VECTOR &&other) noexcept : std::vector<G2>(std::move(other)), dim(other.dim), isDimSet(other.isDimSet) {}
   G2_VECTOR(const g2_vector_ptr &g2_vector);
 
   ~G2_VECTOR() { this->clear(); this->dim = 0; this->isDimSet = false; }
@@ -114,8 +123,11 @@ public:
 
   bool operator==(const G2_VECTOR &x) const;
   G2_VECTOR& operator=(const G2_VECTOR &other);
+  G2_VECTOR& operator=(G2_VECTOR &&other) noexcept;
   G2_VECTOR  operator+(const G2_VECTOR &other) const;
   G2_VECTOR  operator*(const ZP &k) const;
+  G2_VECTOR& operator+=(const G2_VECTOR &other);
+  G2_VECTOR& operator*=(const ZP &k);
 
   // Temporary methods for testing, will be removed later
   void random(size_t dim) {
@@ -146,4 +158,19 @@ bool map_compare (Map const &lhs, Map const &rhs) {
 ZP hashToZP(const std::string &str);
 ZP hashToZP(const std::string &str, const bn_t order);
 
+// result[i] = hashToZP(strs[i], order), the strings are hashed at once (see md_batch.hpp)
+std::vector<ZP> hashToZP(const std::vector<std::string> &strs, const bn_t order);
+
+typedef std::array<uint8_t, RLC_MD_LEN> session_key_t;
+
+/*
+ * Session key of gt: the first RLC_MD_LEN bytes of GT::hashToBytes, so that
+ * the ciphertexts of earlier versions give the same keys. The buffer of
+ * hashToBytes is freed before returning. The span version fails if
+ * session_key is shorter, the array version throws std::runtime_error if the
+ * key cannot be derived.
+ */
+session_key_t deriveSessionKey(const GT &gt);
+bool deriveSessionKey(std::span<uint8_t> session_key, const GT &gt);
+
 #endif // __VECTOR_EC_H__
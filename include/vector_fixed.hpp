@@ -0,0 +1,820 @@
+/**
+ * @file vector_fixed.hpp
+ * @brief Vectors of G1/G2 elements whose dimension is known at compile time
+ * @date 2024-05-28
+ *
+ */
+
+#ifndef __VECTOR_FIXED_HPP__
+#define __VECTOR_FIXED_HPP__
+
+#include <stdexcept>
+#include <type_traits>
+
+#include "vector_ec.hpp"
+#include "byte_stream.hpp"
+
+/*
+ * The scheme only uses the dimensions ND, NF, NG and NH, so the vectors of the
+ * keys and ciphertexts are stored inline: no heap allocation per vector, and a
+ * dimension mismatch is a compilation error. The coordinates are kept in a
+ * contiguous g1_t/g2_t array which is given as is to pc_map_sim. The wire
+ * format is the one of G1_VECTOR/G2_VECTOR, which remain available for other
+ * sizes. Points may also be written uncompressed (types 0xE1/0xE2): twice the
+ * size, but decoding needs no square root.
+ *
+ * Products by a scalar and sums of such products build a LinComb expression,
+ * evaluated coordinate by coordinate when it is assigned to a vector: a chain
+ * like x * a + y * b + z * c is computed in one pass, without intermediate
+ * vectors, and two terms at a time with a simultaneous multiplication.
+ */
+
+template <class Vec, size_t K> class LinComb;
+
+template <size_t N>
+class G1Vec {
+  static_assert(N > 0 && N <= UINT8_MAX, "The dimension of a vector must fit in a byte");
+
+  public:
+    G1Vec();
+    G1Vec(const G1Vec &other);
+    explicit G1Vec(const g1_vector_ptr &g1_vector);
+    explicit G1Vec(const G1_VECTOR &vect);
+
+    ~G1Vec();
+
+    G1Vec& operator=(const G1Vec &other);
+
+    template <size_t K> G1Vec(const LinComb<G1Vec, K> &expr);
+    template <size_t K> G1Vec& operator=(const LinComb<G1Vec, K> &expr);
+
+    static constexpr size_t getDim() { return N; }
+
+    G1 get(size_t i) const { return G1(this->elements[i]); }
+    void set(size_t i, const G1 &element) { g1_copy(this->elements[i], element.m_G1); }
+
+    // Coordinates, in the layout expected by RELIC
+    g1_t* data() { return this->elements; }
+    const g1_t* data() const { return this->elements; }
+
+    G1_VECTOR toVector() const;
+
+    // Size of one point, compressed or not
+    static size_t getPointSize(bool compressed = BIN_COMPRESSED);
+
+    static size_t getSizeInBytes(bool compressed = BIN_COMPRESSED);
+    static size_t getEncodedSize(bool compressed = BIN_COMPRESSED) { return getSizeInBytes(compressed) - 1; }
+
+    // The type byte records whether the points are compressed
+    void serialize(ByteString &result, bool compressed = BIN_COMPRESSED) const;
+    void serialize(ByteWriter &writer, bool compressed = BIN_COMPRESSED) const;
+    void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
+
+    // Only the N points, without type, dimension and size
+    void serializePoints(ByteWriter &writer, bool compressed = BIN_COMPRESSED) const;
+    void deserializePoints(ByteReader &reader, bool compressed = BIN_COMPRESSED);
+
+    bool operator==(const G1Vec &x) const;
+    LinComb<G1Vec, 2> operator+(const G1Vec &other) const&;
+    LinComb<G1Vec, 1> operator*(const ZP &k) const&;
+
+    // An expression refers to its vectors: none of them may be a temporary
+    LinComb<G1Vec, 2> operator+(const G1Vec &other) const&& = delete;
+    LinComb<G1Vec, 2> operator+(G1Vec &&other) const& = delete;
+    LinComb<G1Vec, 1> operator*(const ZP &k) const&& = delete;
+
+    // In place operations
+    G1Vec& operator+=(const G1Vec &other);
+    G1Vec& operator*=(const ZP &k);
+    template <size_t K> G1Vec& operator+=(const LinComb<G1Vec, K> &expr);
+
+    // this += x * k
+    G1Vec& add_mul(const G1Vec &x, const ZP &k);
+
+    // Convert the coordinates to affine form, with one shared inversion
+    void normalize();
+
+  private:
+    g1_t elements[N];
+};
+
+template <size_t N>
+class G2Vec {
+  static_assert(N > 0 && N <= UINT8_MAX, "The dimension of a vector must fit in a byte");
+
+  public:
+    G2Vec();
+    G2Vec(const G2Vec &other);
+    explicit G2Vec(const g2_vector_ptr &g2_vector);
+    explicit G2Vec(const G2_VECTOR &vect);
+
+    ~G2Vec();
+
+    G2Vec& operator=(const G2Vec &other);
+
+    template <size_t K> G2Vec(const LinComb<G2Vec, K> &expr);
+    template <size_t K> G2Vec& operator=(const LinComb<G2Vec, K> &expr);
+
+    static constexpr size_t getDim() { return N; }
+
+    G2 get(size_t i) const { return G2(this->elements[i]); }
+    void set(size_t i, const G2 &element) { g2_copy(this->elements[i], element.m_G2); }
+
+    // Coordinates, in the layout expected by RELIC
+    g2_t* data() { return this->elements; }
+    const g2_t* data() const { return this->elements; }
+
+    G2_VECTOR toVector() const;
+
+    // Size of one point, compressed or not
+    static size_t getPointSize(bool compressed = BIN_COMPRESSED);
+
+    static size_t getSizeInBytes(bool compressed = BIN_COMPRESSED);
+    static size_t getEncodedSize(bool compressed = BIN_COMPRESSED) { return getSizeInBytes(compressed) - 1; }
+
+    // The type byte records whether the points are compressed
+    void serialize(ByteString &result, bool compressed = BIN_COMPRESSED) const;
+    void serialize(ByteWriter &writer, bool compressed = BIN_COMPRESSED) const;
+    void deserialize(ByteString &input);
+    void deserialize(ByteReader &reader);
+
+    // Only the N points, without type, dimension and size
+    void serializePoints(ByteWriter &writer, bool compressed = BIN_COMPRESSED) const;
+    void deserializePoints(ByteReader &reader, bool compressed = BIN_COMPRESSED);
+
+    bool operator==(const G2Vec &x) const;
+    LinComb<G2Vec, 2> operator+(const G2Vec &other) const&;
+    LinComb<G2Vec, 1> operator*(const ZP &k) const&;
+
+    // An expression refers to its vectors: none of them may be a temporary
+    LinComb<G2Vec, 2> operator+(const G2Vec &other) const&& = delete;
+    LinComb<G2Vec, 2> operator+(G2Vec &&other) const& = delete;
+    LinComb<G2Vec, 1> operator*(const ZP &k) const&& = delete;
+
+    // In place operations
+    G2Vec& operator+=(const G2Vec &other);
+    G2Vec& operator*=(const ZP &k);
+    template <size_t K> G2Vec& operator+=(const LinComb<G2Vec, K> &expr);
+
+    // this += x * k
+    G2Vec& add_mul(const G2Vec &x, const ZP &k);
+
+    // Convert the coordinates to affine form, with one shared inversion
+    void normalize();
+
+  private:
+    g2_t elements[N];
+};
+
+
+/****************************************************************************/
+/*                                 G1Vec<N>                                 */
+/****************************************************************************/
+
+template <size_t N>
+G1Vec<N>::G1Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g1_null(this->elements[i]);
+    g1_new(this->elements[i]);
+    g1_set_infty(this->elements[i]);
+  }
+}
+
+template <size_t N>
+G1Vec<N>::G1Vec(const G1Vec &other) : G1Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g1_copy(this->elements[i], other.elements[i]);
+  }
+}
+
+template <size_t N>
+G1Vec<N>::G1Vec(const g1_vector_ptr &g1_vector) : G1Vec() {
+  if (g1_vector == nullptr || g1_vector->dim != N) {
+    throw std::runtime_error("Cannot build a G1 vector from a vector of another dimension");
+  }
+  for (size_t i = 0; i < N; i++) {
+    g1_copy(this->elements[i], g1_vector->elements[i]);
+  }
+}
+
+template <size_t N>
+G1Vec<N>::G1Vec(const G1_VECTOR &vect) : G1Vec() {
+  if (vect.getDim() != N) {
+    throw std::runtime_error("Cannot build a G1 vector from a vector of another dimension");
+  }
+  for (size_t i = 0; i < N; i++) {
+    g1_copy(this->elements[i], vect.at(i).m_G1);
+  }
+}
+
+template <size_t N>
+G1Vec<N>::~G1Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g1_free(this->elements[i]);
+  }
+}
+
+template <size_t N>
+G1Vec<N>& G1Vec<N>::operator=(const G1Vec &other) {
+  if (this != &other) {
+    for (size_t i = 0; i < N; i++) {
+      g1_copy(this->elements[i], other.elements[i]);
+    }
+  }
+  return *this;
+}
+
+template <size_t N>
+G1_VECTOR G1Vec<N>::toVector() const {
+  G1_VECTOR vect(N);
+  for (size_t i = 0; i < N; i++) {
+    vect.insertElement(this->get(i), i);
+  }
+  return vect;
+}
+
+template <size_t N>
+size_t G1Vec<N>::getPointSize(bool compressed) {
+  return compressed ? G1::getDefaultSize() : 2 * RLC_FP_BYTES + 1;
+}
+
+template <size_t N>
+size_t G1Vec<N>::getSizeInBytes(bool compressed) {
+  // Same layout as G1_VECTOR::getSizeInBytes
+  constexpr size_t type_and_dim = 2 * sizeof(uint8_t);
+  size_t buff_size = getPointSize(compressed) * N;
+  return type_and_dim + sizeof(uint8_t) + smart_sizeof(buff_size) + buff_size + 1;
+}
+
+template <size_t N>
+void G1Vec<N>::serialize(ByteString &result, bool compressed) const {
+  result.fillBuffer(0, getEncodedSize(compressed));
+  ByteWriter writer({result.getInternalPtr(), result.size()});
+  this->serialize(writer, compressed);
+}
+
+template <size_t N>
+void G1Vec<N>::serialize(ByteWriter &writer, bool compressed) const {
+  size_t g1_size = getPointSize(compressed);
+
+  writer.put8(compressed ? VECTOR_G1_ELEMENT : VECTOR_G1_ELEMENT_UNCOMPRESSED);
+  writer.put8((uint8_t)N);
+  writer.putPackHeader(g1_size * N);
+  this->serializePoints(writer, compressed);
+}
+
+template <size_t N>
+void G1Vec<N>::serializePoints(ByteWriter &writer, bool compressed) const {
+  size_t g1_size = getPointSize(compressed);
+  for (size_t i = 0; i < N; i++) {
+    g1_write_bin(writer.advance(g1_size), g1_size, this->elements[i], compressed);
+  }
+}
+
+template <size_t N>
+void G1Vec<N>::deserialize(ByteString &input) {
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
+
+template <size_t N>
+void G1Vec<N>::deserialize(ByteReader &reader) {
+  uint8_t type = reader.get8();
+  if ((type != VECTOR_G1_ELEMENT && type != VECTOR_G1_ELEMENT_UNCOMPRESSED) || reader.get8() != N) {
+    throw std::runtime_error("Invalid G1 vector type or dimension");
+  }
+
+  bool compressed = (type == VECTOR_G1_ELEMENT);
+  if (reader.getPackHeader() != getPointSize(compressed) * N) {
+    throw std::runtime_error("Invalid G1 vector size");
+  }
+  this->deserializePoints(reader, compressed);
+}
+
+template <size_t N>
+void G1Vec<N>::deserializePoints(ByteReader &reader, bool compressed) {
+  size_t g1_size = getPointSize(compressed);
+  for (size_t i = 0; i < N; i++) {
+    g1_read_bin(this->elements[i], reader.advance(g1_size), g1_size);
+  }
+}
+
+template <size_t N>
+bool G1Vec<N>::operator==(const G1Vec &x) const {
+  for (size_t i = 0; i < N; i++) {
+    if (g1_cmp(this->elements[i], x.elements[i]) != RLC_EQ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <size_t N>
+LinComb<G1Vec<N>, 2> G1Vec<N>::operator+(const G1Vec &other) const& {
+  return LinComb<G1Vec, 1>(*this) + LinComb<G1Vec, 1>(other);
+}
+
+template <size_t N>
+LinComb<G1Vec<N>, 1> G1Vec<N>::operator*(const ZP &k) const& {
+  return LinComb<G1Vec, 1>(*this, k);
+}
+
+template <size_t N>
+G1Vec<N>& G1Vec<N>::operator+=(const G1Vec &other) {
+  for (size_t i = 0; i < N; i++) {
+    g1_add(this->elements[i], this->elements[i], other.elements[i]);
+  }
+  return *this;
+}
+
+template <size_t N>
+G1Vec<N>& G1Vec<N>::operator*=(const ZP &k) {
+  for (size_t i = 0; i < N; i++) {
+    g1_mul(this->elements[i], this->elements[i], k.m_ZP);
+  }
+  return *this;
+}
+
+template <size_t N>
+G1Vec<N>& G1Vec<N>::add_mul(const G1Vec &x, const ZP &k) {
+  g1_t t;
+  g1_null(t);
+  g1_new(t);
+  for (size_t i = 0; i < N; i++) {
+    g1_mul(t, x.elements[i], k.m_ZP);
+    g1_add(this->elements[i], this->elements[i], t);
+  }
+  g1_free(t);
+  return *this;
+}
+
+template <size_t N>
+void G1Vec<N>::normalize() {
+  for (size_t i = 0; i < N; i++) {
+    // The point at infinity has no inverse, normalize one point at a time
+    if (g1_is_infty(this->elements[i])) {
+      for (size_t j = 0; j < N; j++) {
+        g1_norm(this->elements[j], this->elements[j]);
+      }
+      return;
+    }
+  }
+  ep_norm_sim(this->elements, this->elements, N);
+}
+
+template <size_t N>
+template <size_t K>
+G1Vec<N>::G1Vec(const LinComb<G1Vec, K> &expr) : G1Vec() {
+  *this = expr;
+}
+
+template <size_t N>
+template <size_t K>
+G1Vec<N>& G1Vec<N>::operator=(const LinComb<G1Vec, K> &expr) {
+  g1_t acc, t;
+  g1_null(acc); g1_new(acc);
+  g1_null(t); g1_new(t);
+
+  // Coordinate i of the result only depends on coordinate i of the terms, so
+  // this vector may also appear in the expression
+  for (size_t i = 0; i < N; i++) {
+    const G1Vec *pending = nullptr;
+    const ZP *pending_k = nullptr;
+
+    g1_set_infty(acc);
+    for (size_t j = 0; j < K; j++) {
+      const G1Vec *x = expr.vects[j];
+      if (expr.is_unit[j]) {
+        g1_add(acc, acc, x->elements[i]);
+      }
+      else if (pending == nullptr) {
+        pending = x; pending_k = &expr.scalars[j];
+      }
+      else {
+        g1_mul_sim(t, pending->elements[i], pending_k->m_ZP, x->elements[i], expr.scalars[j].m_ZP);
+        g1_add(acc, acc, t);
+        pending = nullptr;
+      }
+    }
+    if (pending != nullptr) {
+      g1_mul(t, pending->elements[i], pending_k->m_ZP);
+      g1_add(acc, acc, t);
+    }
+
+    g1_copy(this->elements[i], acc);
+  }
+
+  g1_free(acc);
+  g1_free(t);
+  return *this;
+}
+
+template <size_t N>
+template <size_t K>
+G1Vec<N>& G1Vec<N>::operator+=(const LinComb<G1Vec, K> &expr) {
+  for (size_t j = 0; j < K; j++) {
+    if (expr.is_unit[j])
+      *this += *expr.vects[j];
+    else
+      this->add_mul(*expr.vects[j], expr.scalars[j]);
+  }
+  return *this;
+}
+
+
+/****************************************************************************/
+/*                                 G2Vec<N>                                 */
+/****************************************************************************/
+
+template <size_t N>
+G2Vec<N>::G2Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g2_null(this->elements[i]);
+    g2_new(this->elements[i]);
+    g2_set_infty(this->elements[i]);
+  }
+}
+
+template <size_t N>
+G2Vec<N>::G2Vec(const G2Vec &other) : G2Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g2_copy(this->elements[i], other.elements[i]);
+  }
+}
+
+template <size_t N>
+G2Vec<N>::G2Vec(const g2_vector_ptr &g2_vector) : G2Vec() {
+  if (g2_vector == nullptr || g2_vector->dim != N) {
+    throw std::runtime_error("Cannot build a G2 vector from a vector of another dimension");
+  }
+  for (size_t i = 0; i < N; i++) {
+    g2_copy(this->elements[i], g2_vector->elements[i]);
+  }
+}
+
+template <size_t N>
+G2Vec<N>::G2Vec(const G2_VECTOR &vect) : G2Vec() {
+  if (vect.getDim() != N) {
+    throw std::runtime_error("Cannot build a G2 vector from a vector of another dimension");
+  }
+  for (size_t i = 0; i < N; i++) {
+    g2_copy(this->elements[i], vect.at(i).m_G2);
+  }
+}
+
+template <size_t N>
+G2Vec<N>::~G2Vec() {
+  for (size_t i = 0; i < N; i++) {
+    g2_free(this->elements[i]);
+  }
+}
+
+template <size_t N>
+G2Vec<N>& G2Vec<N>::operator=(const G2Vec &other) {
+  if (this != &other) {
+    for (size_t i = 0; i < N; i++) {
+      g2_copy(this->elements[i], other.elements[i]);
+    }
+  }
+  return *this;
+}
+
+template <size_t N>
+G2_VECTOR G2Vec<N>::toVector() const {
+  G2_VECTOR vect(N);
+  for (size_t i = 0; i < N; i++) {
+    vect.insertElement(this->get(i), i);
+  }
+  return vect;
+}
+
+template <size_t N>
+size_t G2Vec<N>::getPointSize(bool compressed) {
+  return compressed ? G2::getDefaultSize() : 4 * RLC_FP_BYTES + 1;
+}
+
+template <size_t N>
+size_t G2Vec<N>::getSizeInBytes(bool compressed) {
+  // Same layout as G2_VECTOR::getSizeInBytes
+  constexpr size_t type_and_dim = 2 * sizeof(uint8_t);
+  size_t buff_size = getPointSize(compressed) * N;
+  return type_and_dim + sizeof(uint8_t) + smart_sizeof(buff_size) + buff_size + 1;
+}
+
+template <size_t N>
+void G2Vec<N>::serialize(ByteString &result, bool compressed) const {
+  result.fillBuffer(0, getEncodedSize(compressed));
+  ByteWriter writer({result.getInternalPtr(), result.size()});
+  this->serialize(writer, compressed);
+}
+
+template <size_t N>
+void G2Vec<N>::serialize(ByteWriter &writer, bool compressed) const {
+  size_t g2_size = getPointSize(compressed);
+
+  writer.put8(compressed ? VECTOR_G2_ELEMENT : VECTOR_G2_ELEMENT_UNCOMPRESSED);
+  writer.put8((uint8_t)N);
+  writer.putPackHeader(g2_size * N);
+  this->serializePoints(writer, compressed);
+}
+
+template <size_t N>
+void G2Vec<N>::serializePoints(ByteWriter &writer, bool compressed) const {
+  size_t g2_size = getPointSize(compressed);
+  for (size_t i = 0; i < N; i++) {
+    g2_write_bin(writer.advance(g2_size), g2_size, this->elements[i], compressed);
+  }
+}
+
+template <size_t N>
+void G2Vec<N>::deserialize(ByteString &input) {
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
+
+template <size_t N>
+void G2Vec<N>::deserialize(ByteReader &reader) {
+  uint8_t type = reader.get8();
+  if ((type != VECTOR_G2_ELEMENT && type != VECTOR_G2_ELEMENT_UNCOMPRESSED) || reader.get8() != N) {
+    throw std::runtime_error("Invalid G2 vector type or dimension");
+  }
+
+  bool compressed = (type == VECTOR_G2_ELEMENT);
+  if (reader.getPackHeader() != getPointSize(compressed) * N) {
+    throw std::runtime_error("Invalid G2 vector size");
+  }
+  this->deserializePoints(reader, compressed);
+}
+
+template <size_t N>
+void G2Vec<N>::deserializePoints(ByteReader &reader, bool compressed) {
+  size_t g2_size = getPointSize(compressed);
+  for (size_t i = 0; i < N; i++) {
+    g2_read_bin(this->elements[i], reader.advance(g2_size), g2_size);
+  }
+}
+
+template <size_t N>
+bool G2Vec<N>::operator==(const G2Vec &x) const {
+  for (size_t i = 0; i < N; i++) {
+    if (g2_cmp(this->elements[i], x.elements[i]) != RLC_EQ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <size_t N>
+LinComb<G2Vec<N>, 2> G2Vec<N>::operator+(const G2Vec &other) const& {
+  return LinComb<G2Vec, 1>(*this) + LinComb<G2Vec, 1>(other);
+}
+
+template <size_t N>
+LinComb<G2Vec<N>, 1> G2Vec<N>::operator*(const ZP &k) const& {
+  return LinComb<G2Vec, 1>(*this, k);
+}
+
+template <size_t N>
+G2Vec<N>& G2Vec<N>::operator+=(const G2Vec &other) {
+  for (size_t i = 0; i < N; i++) {
+    g2_add(this->elements[i], this->elements[i], other.elements[i]);
+  }
+  return *this;
+}
+
+template <size_t N>
+G2Vec<N>& G2Vec<N>::operator*=(const ZP &k) {
+  for (size_t i = 0; i < N; i++) {
+    g2_mul(this->elements[i], this->elements[i], k.m_ZP);
+  }
+  return *this;
+}
+
+template <size_t N>
+G2Vec<N>& G2Vec<N>::add_mul(const G2Vec &x, const ZP &k) {
+  g2_t t;
+  g2_null(t);
+  g2_new(t);
+  for (size_t i = 0; i < N; i++) {
+    g2_mul(t, x.elements[i], k.m_ZP);
+    g2_add(this->elements[i], this->elements[i], t);
+  }
+  g2_free(t);
+  return *this;
+}
+
+template <size_t N>
+void G2Vec<N>::normalize() {
+  for (size_t i = 0; i < N; i++) {
+    // The point at infinity has no inverse, normalize one point at a time
+    if (g2_is_infty(this->elements[i])) {
+      for (size_t j = 0; j < N; j++) {
+        g2_norm(this->elements[j], this->elements[j]);
+      }
+      return;
+    }
+  }
+  ep2_norm_sim(this->elements, this->elements, N);
+}
+
+template <size_t N>
+template <size_t K>
+G2Vec<N>::G2Vec(const LinComb<G2Vec, K> &expr) : G2Vec() {
+  *this = expr;
+}
+
+template <size_t N>
+template <size_t K>
+G2Vec<N>& G2Vec<N>::operator=(const LinComb<G2Vec, K> &expr) {
+  g2_t acc, t;
+  g2_null(acc); g2_new(acc);
+  g2_null(t); g2_new(t);
+
+  // Coordinate i of the result only depends on coordinate i of the terms, so
+  // this vector may also appear in the expression
+  for (size_t i = 0; i < N; i++) {
+    const G2Vec *pending = nullptr;
+    const ZP *pending_k = nullptr;
+
+    g2_set_infty(acc);
+    for (size_t j = 0; j < K; j++) {
+      const G2Vec *x = expr.vects[j];
+      if (expr.is_unit[j]) {
+        g2_add(acc, acc, x->elements[i]);
+      }
+      else if (pending == nullptr) {
+        pending = x; pending_k = &expr.scalars[j];
+      }
+      else {
+        g2_mul_sim(t, pending->elements[i], pending_k->m_ZP, x->elements[i], expr.scalars[j].m_ZP);
+        g2_add(acc, acc, t);
+        pending = nullptr;
+      }
+    }
+    if (pending != nullptr) {
+      g2_mul(t, pending->elements[i], pending_k->m_ZP);
+      g2_add(acc, acc, t);
+    }
+
+    g2_copy(this->elements[i], acc);
+  }
+
+  g2_free(acc);
+  g2_free(t);
+  return *this;
+}
+
+template <size_t N>
+template <size_t K>
+G2Vec<N>& G2Vec<N>::operator+=(const LinComb<G2Vec, K> &expr) {
+  for (size_t j = 0; j < K; j++) {
+    if (expr.is_unit[j])
+      *this += *expr.vects[j];
+    else
+      this->add_mul(*expr.vects[j], expr.scalars[j]);
+  }
+  return *this;
+}
+
+
+/****************************************************************************/
+/*                              LinComb<Vec, K>                             */
+/****************************************************************************/
+
+/*
+ * Sum of K terms x_j * k_j, where k_j may be 1 (is_unit). It only refers to
+ * the vectors x_j: building it from a temporary vector does not compile, and
+ * it cannot be copied outside the operators that build it, so that it is
+ * evaluated while its vectors are alive.
+ */
+template <class Vec, size_t K>
+class LinComb {
+  public:
+    explicit LinComb(const Vec &x) : vects{&x}, is_unit{true} {}
+    LinComb(const Vec &x, const ZP &k) : vects{&x}, scalars{k}, is_unit{false} {}
+    LinComb(Vec &&x) = delete;
+    LinComb(Vec &&x, const ZP &k) = delete;
+
+    LinComb& operator=(const LinComb&) = delete;
+
+    Vec eval() const { return Vec(*this); }
+
+    const Vec *vects[K];
+    ZP scalars[K];
+    bool is_unit[K];
+
+  private:
+    LinComb() = default;
+    LinComb(const LinComb&) = default;
+
+    template <class V, size_t A, size_t B>
+    friend LinComb<V, A + B> operator+(const LinComb<V, A> &a, const LinComb<V, B> &b);
+};
+
+template <class Vec, size_t A, size_t B>
+LinComb<Vec, A + B> operator+(const LinComb<Vec, A> &a, const LinComb<Vec, B> &b) {
+  LinComb<Vec, A + B> result;
+  for (size_t j = 0; j < A; j++) {
+    result.vects[j] = a.vects[j]; result.scalars[j] = a.scalars[j]; result.is_unit[j] = a.is_unit[j];
+  }
+  for (size_t j = 0; j < B; j++) {
+    result.vects[A + j] = b.vects[j]; result.scalars[A + j] = b.scalars[j]; result.is_unit[A + j] = b.is_unit[j];
+  }
+  return result;
+}
+
+template <class Vec, size_t A>
+LinComb<Vec, A + 1> operator+(const LinComb<Vec, A> &a, const Vec &x) {
+  return a + LinComb<Vec, 1>(x);
+}
+
+template <class Vec, size_t B>
+LinComb<Vec, B + 1> operator+(const Vec &x, const LinComb<Vec, B> &b) {
+  return LinComb<Vec, 1>(x) + b;
+}
+
+template <class Vec, size_t A>
+LinComb<Vec, A + 1> operator+(const LinComb<Vec, A> &a, Vec &&x) = delete;
+
+template <class Vec, size_t B>
+LinComb<Vec, B + 1> operator+(Vec &&x, const LinComb<Vec, B> &b) = delete;
+
+template <class Vec, size_t K>
+bool operator==(const LinComb<Vec, K> &expr, const Vec &x) {
+  return expr.eval() == x;
+}
+
+template <class T> struct is_lincomb : std::false_type {};
+template <class Vec, size_t K> struct is_lincomb<LinComb<Vec, K>> : std::true_type {};
+
+template <class Vec, size_t K>
+Vec evaluate(const LinComb<Vec, K> &expr) { return expr.eval(); }
+template <size_t N>
+const G1Vec<N>& evaluate(const G1Vec<N> &x) { return x; }
+template <size_t N>
+const G2Vec<N>& evaluate(const G2Vec<N> &x) { return x; }
+
+
+// Inner product of two vectors of the same dimension, no copy of the points
+template <size_t N>
+GT innerProduct(const G1Vec<N> &x, const G2Vec<N> &y) {
+  GT result;
+  pc_map_sim(result.m_GT, const_cast<g1_t*>(x.data()), const_cast<g2_t*>(y.data()), N);
+  return result;
+}
+
+// Inner product where an operand is an expression, evaluated first
+template <class X, class Y>
+  requires (is_lincomb<X>::value || is_lincomb<Y>::value)
+GT innerProduct(const X &x, const Y &y) {
+  return innerProduct(evaluate(x), evaluate(y));
+}
+
+/*
+ * Product of inner products, computed with a single multi-pairing: the Miller
+ * loops share their squarings and there is one final exponentiation. The
+ * vectors are referenced until compute(), which gathers their points.
+ */
+class PairingProduct {
+  public:
+    template <size_t N>
+    void add(const G1Vec<N> &x, const G2Vec<N> &y) {
+      for (size_t i = 0; i < N; i++) {
+        this->g1_points.push_back(&x.data()[i]);
+        this->g2_points.push_back(&y.data()[i]);
+      }
+    }
+
+    GT compute() const {
+      const size_t n = this->g1_points.size();
+      GT result;
+      if (n == 0) {
+        result.setIdentity();
+        return result;
+      }
+
+      g1_t *x = new g1_t[n];
+      g2_t *y = new g2_t[n];
+      for (size_t i = 0; i < n; i++) {
+        g1_null(x[i]); g1_new(x[i]); g1_copy(x[i], *this->g1_points[i]);
+        g2_null(y[i]); g2_new(y[i]); g2_copy(y[i], *this->g2_points[i]);
+      }
+
+      pc_map_sim(result.m_GT, x, y, n);
+
+      for (size_t i = 0; i < n; i++) {
+        g1_free(x[i]);
+        g2_free(y[i]);
+      }
+      delete[] x;
+      delete[] y;
+      return result;
+    }
+
+  private:
+    std::vector<const g1_t*> g1_points;
+    std::vector<const g2_t*> g2_points;
+};
+
+#endif // __VECTOR_FIXED_HPP__
@@ -0,0 +1,58 @@
+#ifndef _ZP_MATRICES_
+#define _ZP_MATRICES_
+
+#include "matrix.h"
+
+/*
+ * Matrices over Zp (p is the order of the pairing groups) stored in Montgomery
+ * form on fixed-width 64-bit limbs. Unlike the bn_t based matrices, there is
+ * no allocation per entry, no bn_mod after each operation and the modulus is
+ * fetched once, in zp_field_init(). Inner products are accumulated on a double
+ * width accumulator and reduced only once (lazy reduction).
+ */
+
+/* Number of limbs large enough to hold the group order of the curve */
+#define ZP_DIGS             ((RLC_FP_BITS + 63) / 64)
+
+#define ZP_GET(mat, i, j)   mat->entries[((i) * (mat->dim) + (j))]
+#define zp_mat_dim(mat)     (mat->dim)
+
+typedef uint64_t zp_dig_t;
+typedef zp_dig_t zp_elt_t[ZP_DIGS];
+
+typedef struct
+{
+  zp_dig_t prime[ZP_DIGS];  // Modulus p (order of the groups)
+  zp_dig_t one[ZP_DIGS];    // R mod p, Montgomery form of 1
+  zp_dig_t r2[ZP_DIGS];     // R^2 mod p, used to enter the Montgomery form
+  zp_dig_t lazy[ZP_DIGS];   // 2^64 * R mod p, fixes the extra limb of the lazy reduction
+  zp_dig_t u;               // -p^(-1) mod 2^64
+  uint8_t digs;             // Number of limbs used by p, R = 2^(64 * digs)
+} zp_field_st;
+
+typedef struct
+{
+  zp_elt_t *entries;
+  uint8_t dim;
+} zp_mat_st;
+
+typedef zp_field_st zp_field_t[1];
+typedef zp_mat_st zp_mat_t[1];
+
+bool zp_field_init(zp_field_t field);
+
+void zp_from_bn(zp_elt_t c, const bn_t a, const zp_field_t field);
+void zp_to_bn(bn_t c, const zp_elt_t a, const zp_field_t field);
+void zp_mul(zp_elt_t c, const zp_elt_t a, const zp_elt_t b, const zp_field_t field);
+bool zp_inv(zp_elt_t c, const zp_elt_t a, const zp_field_t field);
+
+bool zp_mat_init(zp_mat_t mat, uint8_t dim);
+void zp_mat_rand(zp_mat_t mat, const zp_field_t field);
+void zp_mat_transpose(zp_mat_t mat);
+void zp_mat_product(zp_mat_t dest, const zp_mat_t A, const zp_mat_t B, const zp_field_t field);
+bool zp_mat_invert(zp_mat_t dest, const zp_mat_t src, const zp_field_t field);
+bool zp_mat_export(mat_t dest, const zp_mat_t src, const zp_field_t field);
+bool zp_mat_rand_dual_mat(mat_t mat, mat_t dual_mat, uint8_t dim);
+void zp_mat_clear(zp_mat_t mat);
+
+#endif
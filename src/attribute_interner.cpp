@@ -0,0 +1,105 @@
+/**
+ * @file attribute_interner.cpp
+ * @brief Implementation of the dictionary of attribute and url strings
+ * @date 2024-06-27
+ *
+ */
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+#include "attribute_interner.hpp"
+#include "vector_ec.hpp"
+
+
+// Ids are dense, the next one is the number of entries
+static void check_next_id(size_t nb_entries)
+{
+  if (nb_entries >= std::numeric_limits<attribute_id_t>::max()) {
+    throw std::length_error("Too many interned attributes");
+  }
+}
+
+const InternedAttribute& AttributeInterner::intern(const std::string &name)
+{
+  {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    auto it = this->ids.find(name);
+    if (it != this->ids.end()) return this->entries[it->second];
+  }
+
+  // Hash outside the lock, two threads may hash the same new string
+  BPGroup group;
+  ZP zp = hashToZP(name, group.order);
+  std::string hash_key = OpenABEHashKey(name);
+
+  std::unique_lock<std::shared_mutex> lock(this->mutex);
+  auto found = this->ids.find(name);
+  if (found != this->ids.end()) return this->entries[found->second];
+
+  check_next_id(this->entries.size());
+  attribute_id_t id = this->entries.size();
+  this->ids.emplace(name, id);
+  this->entries.push_back({id, name, std::move(hash_key), zp});
+  return this->entries[id];
+}
+
+const InternedAttribute* AttributeInterner::find(const std::string &name) const
+{
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  auto it = this->ids.find(name);
+  return (it != this->ids.end()) ? &this->entries[it->second] : nullptr;
+}
+
+void AttributeInterner::intern_all(const std::vector<std::string> &names)
+{
+  std::vector<std::string> missing;
+  {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    for (const auto& name : names) {
+      if (this->ids.find(name) == this->ids.end()) missing.push_back(name);
+    }
+  }
+  if (missing.empty()) return;
+
+  std::sort(missing.begin(), missing.end());
+  missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+  BPGroup group;
+  std::vector<ZP> zps = hashToZP(missing, group.order);
+  std::vector<std::string> hash_keys;
+  hash_keys.reserve(missing.size());
+  for (const auto& name : missing) hash_keys.push_back(OpenABEHashKey(name));
+
+  std::unique_lock<std::shared_mutex> lock(this->mutex);
+  for (size_t i = 0; i < missing.size(); i++) {
+    if (this->ids.count(missing[i]) != 0) continue;
+    check_next_id(this->entries.size());
+    attribute_id_t id = this->entries.size();
+    this->ids.emplace(missing[i], id);
+    this->entries.push_back({id, missing[i], std::move(hash_keys[i]), zps[i]});
+  }
+}
+
+const InternedAttribute& AttributeInterner::get(attribute_id_t id) const
+{
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  if (id >= this->entries.size()) {
+    throw std::out_of_range("Unknown attribute id");
+  }
+  return this->entries[id];
+}
+
+size_t AttributeInterner::size() const
+{
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  return this->entries.size();
+}
+
+AttributeInterner& AttributeInterner::global()
+{
+  static AttributeInterner interner;
+  return interner;
+}
@@ -1,27 +1,44 @@
+#include <stddef.h>
+
 #include "dpvs.h"
 
+/*
+ * Arena layout: a vector is allocated with its coordinates, and a base with
+ * its vector pointers, its vector headers and its dim * dim points. A dpvs_t
+ * holds both bases in the same block. Each of them is released by one free().
+ */
+#define DPVS_ALIGN(size)  ((((size) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t)) * _Alignof(max_align_t))
+
+#define G1_VECT_SIZE(dim) (DPVS_ALIGN(sizeof(g1_vector_t)) + (dim) * sizeof(g1_t))
+#define G2_VECT_SIZE(dim) (DPVS_ALIGN(sizeof(g2_vector_t)) + (dim) * sizeof(g2_t))
+#define G1_BASE_SIZE(dim) (DPVS_ALIGN((dim) * sizeof(g1_vector_ptr)) + \
+                           DPVS_ALIGN((dim) * sizeof(g1_vector_t)) + DPVS_ALIGN((dim) * (dim) * sizeof(g1_t)))
+#define G2_BASE_SIZE(dim) (DPVS_ALIGN((dim) * sizeof(g2_vector_ptr)) + \
+                           DPVS_ALIGN((dim) * sizeof(g2_vector_t)) + DPVS_ALIGN((dim) * (dim) * sizeof(g2_t)))
+
+/************************ STATIC FUNCTION PROTOTYPES ************************/
+static bool g1_elements_init(g1_t *elements, int n);
+static bool g2_elements_init(g2_t *elements, int n);
+static void g1_elements_clear(g1_t *elements, int n);
+static void g2_elements_clear(g2_t *elements, int n);
+static G1_VS_BASE g1_base_build(uint8_t *block, uint8_t dim);
+static G2_VS_BASE g2_base_build(uint8_t *block, uint8_t dim);
+/****************************************************************************/
+
 g1_vector_ptr dpvs_create_g1_vect(uint8_t dim) {
   g1_vector_ptr vect = NULL;
-  
-  if (dim != 0 && (vect = (g1_vector_ptr) malloc(sizeof(g1_vector_t)))) {
-    vect->dim = dim;
-    if ((vect->elements = (g1_t *) malloc(dim * sizeof(g1_t))) == NULL) {
-      free(vect);
+
+  if (dim != 0) {
+    if ((vect = (g1_vector_ptr) malloc(G1_VECT_SIZE(dim))) == NULL) {
       _error_alloc_fail_();
+      return NULL;
     }
-    else {
-      int i = 0;
-      RLC_TRY {
-        for (; i < dim; i++) {
-          g1_null(vect->elements[i]);
-          g1_new(vect->elements[i]);
-        }
-      }
-      RLC_CATCH_ANY {
-        vect->dim = i;
-        dpvs_clear_g1_vect(vect);
-        _error_alloc_fail_();
-      }
+
+    vect->dim = dim;
+    vect->elements = (g1_t *) ((uint8_t *) vect + DPVS_ALIGN(sizeof(g1_vector_t)));
+    if (!g1_elements_init(vect->elements, dim)) {
+      free(vect);
+      vect = NULL;
     }
   }
 
@@ -30,26 +47,18 @@ g1_vector_ptr dpvs_create_g1_vect(uint8_t dim) {
 
 g2_vector_ptr dpvs_create_g2_vect(uint8_t dim) {
   g2_vector_ptr vect = NULL;
-  
-  if (dim != 0 && (vect = (g2_vector_ptr) malloc(sizeof(g2_vector_t)))) {
-    vect->dim = dim;
-    if ((vect->elements = (g2_t *) malloc(dim * sizeof(g2_t))) == NULL) {
-      free(vect);
+
+  if (dim != 0) {
+    if ((vect = (g2_vector_ptr) malloc(G2_VECT_SIZE(dim))) == NULL) {
       _error_alloc_fail_();
+      return NULL;
     }
-    else {
-      int i = 0;
-      RLC_TRY {
-        for (; i < dim; i++) {
-          g2_null(vect->elements[i]);
-          g2_new(vect->elements[i]);
-        }
-      }
-      RLC_CATCH_ANY {
-        vect->dim = i;
-        dpvs_clear_g2_vect(vect);
-        _error_alloc_fail_();
-      }
+
+    vect->dim = dim;
+    vect->elements = (g2_t *) ((uint8_t *) vect + DPVS_ALIGN(sizeof(g2_vector_t)));
+    if (!g2_elements_init(vect->elements, dim)) {
+      free(vect);
+      vect = NULL;
     }
   }
 
@@ -60,57 +69,58 @@ G1_VS_BASE dpvs_create_g1_base(uint8_t dim)
 {
   if (dim == 0) return NULL;
 
-  G1_VS_BASE vect = (G1_VS_BASE) malloc(dim * sizeof(g1_vector_ptr));
-  if (vect != NULL) {
-    for (uint8_t i = 0; i < dim; i++) {
-      if ((vect[i] = dpvs_create_g1_vect(dim)) == NULL) {
-        for (; i > 0; i--) free(vect[i-1]);
-        free(vect);
-        _error_alloc_fail_();
-        break;
-      }
-    }
+  uint8_t *block = (uint8_t *) malloc(G1_BASE_SIZE(dim));
+  if (block == NULL) {
+    _error_alloc_fail_();
+    return NULL;
   }
 
-  return vect;
+  G1_VS_BASE base = g1_base_build(block, dim);
+  if (base == NULL) free(block);
+
+  return base;
 }
 
 G2_VS_BASE dpvs_create_g2_base(uint8_t dim)
 {
   if (dim == 0) return NULL;
 
-  G2_VS_BASE vect = (G2_VS_BASE) malloc(dim * sizeof(g2_vector_ptr));
-  if (vect != NULL) {
-    for (uint8_t i = 0; i < dim; i++) {
-      if ((vect[i] = dpvs_create_g2_vect(dim)) == NULL) {
-        for (; i > 0; i--) free(vect[i-1]);
-        free(vect);
-        _error_alloc_fail_();
-        break;
-      }
-    }
+  uint8_t *block = (uint8_t *) malloc(G2_BASE_SIZE(dim));
+  if (block == NULL) {
+    _error_alloc_fail_();
+    return NULL;
   }
 
-  return vect;
+  G2_VS_BASE base = g2_base_build(block, dim);
+  if (base == NULL) free(block);
+
+  return base;
 }
 
 dpvs_t* dpvs_create_bases(uint8_t dim)
 {
   if (dim == 0) return NULL;
 
-  dpvs_t* dpvs = (dpvs_t*) malloc(sizeof(dpvs_t));
-  if (dpvs == NULL) return NULL;
+  const size_t g1_offset = DPVS_ALIGN(sizeof(dpvs_t));
+  const size_t g2_offset = g1_offset + G1_BASE_SIZE(dim);
+
+  uint8_t *block = (uint8_t *) malloc(g2_offset + G2_BASE_SIZE(dim));
+  if (block == NULL) {
+    _error_alloc_fail_();
+    return NULL;
+  }
+
+  dpvs_t* dpvs = (dpvs_t*) block;
   dpvs->dim = dim;
 
-  dpvs->base = dpvs_create_g1_base(dim);
-  if (dpvs->base == NULL) {
-    free(dpvs);
+  if ((dpvs->base = g1_base_build(block + g1_offset, dim)) == NULL) {
+    free(block);
     return NULL;
   }
 
-  dpvs->dual_base = dpvs_create_g2_base(dim);
-  if (dpvs->dual_base == NULL) {
-    free(dpvs->base); free(dpvs);
+  if ((dpvs->dual_base = g2_base_build(block + g2_offset, dim)) == NULL) {
+    g1_elements_clear(dpvs->base[0]->elements, dim * dim);
+    free(block);
     return NULL;
   }
 
@@ -120,8 +130,8 @@ dpvs_t* dpvs_create_bases(uint8_t dim)
 dpvs_t* dpvs_generate_bases(uint8_t dim)
 {
   dpvs_t* dpvs = NULL;
+  dpvs_tables_t tables;
   mat_t mat, dual_mat;
-  bn_vect_t row, drow;
 
   if ((dpvs = dpvs_create_bases(dim)) == NULL) {
     fprintf(stderr, "[Errors] generate_dpvs_bases: dpvs initialization failled\n");
@@ -129,34 +139,124 @@ dpvs_t* dpvs_generate_bases(uint8_t dim)
   }
 
   if (dpvs_gen_matrices(mat, dual_mat, dim)) {
-    if (bn_vect_init(row, dim) && bn_vect_init(drow, dim)) {
+    if (dpvs_tables_init(&tables)) {
       for (uint8_t i = 0; i < dim; i++) {
-        dpvs_get_mat_row(row, mat, i);
-        dpvs_get_mat_row(drow, dual_mat, i);
-        for (uint8_t j = 0; j < dim; j++) {
-          g1_mul_gen(dpvs->base[i]->elements[j], row->elements[j]);
-          g2_mul_gen(dpvs->dual_base[i]->elements[j], drow->elements[j]);
-        }
+        dpvs_set_base_row(dpvs, mat, &tables, i);
+        dpvs_set_dual_base_row(dpvs, dual_mat, &tables, i);
       }
+      dpvs_tables_clear(&tables);
     }
     else {
-      fprintf(stderr, "[Errors] generate_dpvs_bases: vectors initialization failled\n");
+      fprintf(stderr, "[Errors] generate_dpvs_bases: tables initialization failled\n");
       dpvs_clear(dpvs);
+      dpvs = NULL;
     }
   }
   else {
     fprintf(stderr, "[Errors] generate_dpvs_bases: dpvs entries, initialization failled\n");
     dpvs_clear(dpvs);
+    dpvs = NULL;
   }
 
-  bn_vect_clear(row);
-  bn_vect_clear(drow);
   mat_clear(mat);
   mat_clear(dual_mat);
 
   return dpvs;
 }
 
+bool dpvs_tables_init(dpvs_tables_t* tables)
+{
+  tables->g1_table = NULL;
+  tables->g2_table = NULL;
+
+#if !defined(EP_PRECO)
+  g1_t g1_gen;
+  g2_t g2_gen;
+
+  tables->g1_table = (g1_t *) malloc(RLC_G1_TABLE * sizeof(g1_t));
+  tables->g2_table = (g2_t *) malloc(RLC_G2_TABLE * sizeof(g2_t));
+  if (tables->g1_table == NULL || tables->g2_table == NULL) {
+    free(tables->g1_table);
+    free(tables->g2_table);
+    tables->g1_table = NULL;
+    tables->g2_table = NULL;
+    return _error_alloc_fail_();
+  }
+
+  bool is_init = true;
+
+  g1_null(g1_gen);
+  g2_null(g2_gen);
+  for (int i = 0; i < RLC_G1_TABLE; i++) g1_null(tables->g1_table[i]);
+  for (int i = 0; i < RLC_G2_TABLE; i++) g2_null(tables->g2_table[i]);
+
+  RLC_TRY {
+    g1_new(g1_gen);
+    g2_new(g2_gen);
+    for (int i = 0; i < RLC_G1_TABLE; i++) g1_new(tables->g1_table[i]);
+    for (int i = 0; i < RLC_G2_TABLE; i++) g2_new(tables->g2_table[i]);
+
+    g1_get_gen(g1_gen);
+    g2_get_gen(g2_gen);
+    g1_mul_pre(tables->g1_table, g1_gen);
+    g2_mul_pre(tables->g2_table, g2_gen);
+  }
+  RLC_CATCH_ANY {
+    is_init = false;
+  }
+  RLC_FINALLY {
+    g1_free(g1_gen);
+    g2_free(g2_gen);
+  }
+
+  /* Returning from RLC_CATCH_ANY would skip RLC_FINALLY */
+  if (!is_init) {
+    dpvs_tables_clear(tables);
+    return _error_alloc_fail_();
+  }
+#endif
+
+  return true;
+}
+
+void dpvs_tables_clear(dpvs_tables_t* tables)
+{
+  if (tables->g1_table) {
+    for (int i = 0; i < RLC_G1_TABLE; i++) g1_free(tables->g1_table[i]);
+    free(tables->g1_table);
+    tables->g1_table = NULL;
+  }
+  if (tables->g2_table) {
+    for (int i = 0; i < RLC_G2_TABLE; i++) g2_free(tables->g2_table[i]);
+    free(tables->g2_table);
+    tables->g2_table = NULL;
+  }
+}
+
+void dpvs_set_base_row(dpvs_t* dpvs, const mat_t mat, const dpvs_tables_t* tables, uint8_t i)
+{
+  if (i >= dpvs->dim || mat_dim(mat) != dpvs->dim) return;
+
+  for (uint8_t j = 0; j < dpvs->dim; j++) {
+    if (tables->g1_table)
+      g1_mul_fix(dpvs->base[i]->elements[j], (const g1_t *) tables->g1_table, GET(mat, i, j));
+    else
+      g1_mul_gen(dpvs->base[i]->elements[j], GET(mat, i, j));
+  }
+}
+
+void dpvs_set_dual_base_row(dpvs_t* dpvs, const mat_t dual_mat, const dpvs_tables_t* tables, uint8_t i)
+{
+  if (i >= dpvs->dim || mat_dim(dual_mat) != dpvs->dim) return;
+
+  for (uint8_t j = 0; j < dpvs->dim; j++) {
+    if (tables->g2_table)
+      g2_mul_fix(dpvs->dual_base[i]->elements[j], (const g2_t *) tables->g2_table, GET(dual_mat, i, j));
+    else
+      g2_mul_gen(dpvs->dual_base[i]->elements[j], GET(dual_mat, i, j));
+  }
+}
+
 void dpvs_k_mul_g1_vect(g1_vector_ptr dest, const g1_vector_ptr src, const bn_t k)
 {
   if (dest && src && dest->dim == src->dim) {
@@ -238,11 +338,7 @@ bool dpvs_compare_g2_vect(const g2_vector_ptr vect1, const g2_vector_ptr vect2)
 void dpvs_clear_g1_vect(g1_vector_ptr vect)
 {
   if (vect) {
-    if (vect->elements) {
-      for (uint8_t i = 0; i < vect->dim; i++) g1_free(vect->elements[i]);
-
-      free(vect->elements);
-    }
+    g1_elements_clear(vect->elements, vect->dim);
     free(vect);
   }
 }
@@ -250,27 +346,115 @@ void dpvs_clear_g1_vect(g1_vector_ptr vect)
 void dpvs_clear_g2_vect(g2_vector_ptr vect)
 {
   if (vect) {
-    if (vect->elements) {
-      for (uint8_t i = 0; i < vect->dim; i++) g2_free(vect->elements[i]);
-
-      free(vect->elements);
-    }
+    g2_elements_clear(vect->elements, vect->dim);
     free(vect);
   }
 }
 
+void dpvs_clear_g1_base(G1_VS_BASE base, uint8_t dim)
+{
+  if (base) {
+    g1_elements_clear(base[0]->elements, dim * dim);
+    free(base);
+  }
+}
+
+void dpvs_clear_g2_base(G2_VS_BASE base, uint8_t dim)
+{
+  if (base) {
+    g2_elements_clear(base[0]->elements, dim * dim);
+    free(base);
+  }
+}
+
 void dpvs_clear(dpvs_t* dpvs)
 {
   if (dpvs) {
-    if (dpvs->base && dpvs->dual_base) {
-      for (uint8_t i = 0; i < dpvs->dim; i++)
-      {
-        dpvs_clear_g1_vect(dpvs->base[i]);
-        dpvs_clear_g2_vect(dpvs->dual_base[i]);
-      }
-      free(dpvs->base);
-      free(dpvs->dual_base);
-    }
+    /* Both bases live in the block of dpvs */
+    g1_elements_clear(dpvs->base[0]->elements, dpvs->dim * dpvs->dim);
+    g2_elements_clear(dpvs->dual_base[0]->elements, dpvs->dim * dpvs->dim);
     free(dpvs);
   }
 }
+
+/*****************************************************************************
+****************************** STATIC FUNCTIONS ******************************
+******************************************************************************/
+
+static bool g1_elements_init(g1_t *elements, int n)
+{
+  int i = 0;
+  RLC_TRY {
+    for (; i < n; i++) {
+      g1_null(elements[i]);
+      g1_new(elements[i]);
+    }
+  }
+  RLC_CATCH_ANY {
+    g1_elements_clear(elements, i);
+    return _error_alloc_fail_();
+  }
+  return true;
+}
+
+static bool g2_elements_init(g2_t *elements, int n)
+{
+  int i = 0;
+  RLC_TRY {
+    for (; i < n; i++) {
+      g2_null(elements[i]);
+      g2_new(elements[i]);
+    }
+  }
+  RLC_CATCH_ANY {
+    g2_elements_clear(elements, i);
+    return _error_alloc_fail_();
+  }
+  return true;
+}
+
+static void g1_elements_clear(g1_t *elements, int n)
+{
+  for (int i = 0; i < n; i++) g1_free(elements[i]);
+}
+
+static void g2_elements_clear(g2_t *elements, int n)
+{
+  for (int i = 0; i < n; i++) g2_free(elements[i]);
+}
+
+/* Carve a base of G1^dim out of block, whose size is G1_BASE_SIZE(dim) */
+static G1_VS_BASE g1_base_build(uint8_t *block, uint8_t dim)
+{
+  G1_VS_BASE base = (G1_VS_BASE) block;
+  g1_vector_t *vects = (g1_vector_t *) (block + DPVS_ALIGN(dim * sizeof(g1_vector_ptr)));
+  g1_t *elements = (g1_t *) ((uint8_t *) vects + DPVS_ALIGN(dim * sizeof(g1_vector_t)));
+
+  if (!g1_elements_init(elements, dim * dim)) return NULL;
+
+  for (uint8_t i = 0; i < dim; i++) {
+    vects[i].dim = dim;
+    vects[i].elements = elements + i * dim;
+    base[i] = &vects[i];
+  }
+
+  return base;
+}
+
+/* Carve a base of G2^dim out of block, whose size is G2_BASE_SIZE(dim) */
+static G2_VS_BASE g2_base_build(uint8_t *block, uint8_t dim)
+{
+  G2_VS_BASE base = (G2_VS_BASE) block;
+  g2_vector_t *vects = (g2_vector_t *) (block + DPVS_ALIGN(dim * sizeof(g2_vector_ptr)));
+  g2_t *elements = (g2_t *) ((uint8_t *) vects + DPVS_ALIGN(dim * sizeof(g2_vector_t)));
+
+  if (!g2_elements_init(elements, dim * dim)) return NULL;
+
+  for (uint8_t i = 0; i < dim; i++) {
+    vects[i].dim = dim;
+    vects[i].elements = elements + i * dim;
+    base[i] = &vects[i];
+  }
+
+  return base;
+}
@@ -7,6 +7,9 @@
  */
 
 #include "keys.hpp"
+#include "thread_pool.hpp"
+#include "subgroup_check.hpp"
+#include "attribute_interner.hpp"
 
 
 /*****************************************************************************/
@@ -21,22 +24,33 @@ void KPABE_DPVS_PUBLIC_KEY::set_bases(const G1_VS_BASE base_D,
   if (base_D[0]->dim == ND && base_F[0]->dim == NF &&
       base_G[0]->dim == NG && base_H[0]->dim == NH)
   {
-    this->d1 = G1_VECTOR(base_D[0]);
-    this->d3 = G1_VECTOR(base_D[2]);
+    this->d1 = G1Vec<ND>(base_D[0]);
+    this->d3 = G1Vec<ND>(base_D[2]);
 
-    this->f1 = G1_VECTOR(base_F[0]);
-    this->f2 = G1_VECTOR(base_F[1]);
-    this->f3 = G1_VECTOR(base_F[2]);
+    this->f1 = G1Vec<NF>(base_F[0]);
+    this->f2 = G1Vec<NF>(base_F[1]);
+    this->f3 = G1Vec<NF>(base_F[2]);
 
-    this->g1 = G1_VECTOR(base_G[0]);
-    this->g2 = G1_VECTOR(base_G[1]);
+    this->g1 = G1Vec<NG>(base_G[0]);
+    this->g2 = G1Vec<NG>(base_G[1]);
 
-    this->h1 = G1_VECTOR(base_H[0]);
-    this->h2 = G1_VECTOR(base_H[1]);
-    this->h3 = G1_VECTOR(base_H[2]);
+    this->h1 = G1Vec<NH>(base_H[0]);
+    this->h2 = G1Vec<NH>(base_H[1]);
+    this->h3 = G1Vec<NH>(base_H[2]);
+
+    this->normalize();
   }
 }
 
+void KPABE_DPVS_PUBLIC_KEY::normalize()
+{
+  this->d1.normalize(); this->d3.normalize();
+  this->f1.normalize(); this->f2.normalize(); this->f3.normalize();
+  this->g1.normalize(); this->g2.normalize();
+  this->h1.normalize(); this->h2.normalize(); this->h3.normalize();
+}
+
+/* The ten vectors are multiplied concurrently, one job per vector */
 std::pair<KPABE_DPVS_PUBLIC_KEY, ZP> KPABE_DPVS_PUBLIC_KEY::randomize() const
 {
   KPABE_DPVS_PUBLIC_KEY result;
@@ -44,20 +58,101 @@ std::pair<KPABE_DPVS_PUBLIC_KEY, ZP> KPABE_DPVS_PUBLIC_KEY::randomize() const
   ZP rand;
   rand.setRandom(group.order);
 
-  result.d1 = this->d1 * rand; result.d3 = this->d3 * rand;
-  result.f1 = this->f1 * rand; result.f2 = this->f2 * rand; result.f3 = this->f3 * rand;
-  result.g1 = this->g1 * rand; result.g2 = this->g2 * rand;
-  result.h1 = this->h1 * rand; result.h2 = this->h2 * rand; result.h3 = this->h3 * rand;
+  auto scale = [&rand](auto &dest, const auto &src) {
+    dest = src * rand;
+    dest.normalize();
+  };
+
+  const std::vector<std::function<void()>> jobs = {
+    [&] { scale(result.d1, this->d1); }, [&] { scale(result.d3, this->d3); },
+    [&] { scale(result.f1, this->f1); }, [&] { scale(result.f2, this->f2); },
+    [&] { scale(result.f3, this->f3); },
+    [&] { scale(result.g1, this->g1); }, [&] { scale(result.g2, this->g2); },
+    [&] { scale(result.h1, this->h1); }, [&] { scale(result.h2, this->h2); },
+    [&] { scale(result.h3, this->h3); },
+  };
+  ThreadPool::global().parallel_for(jobs.size(), [&](size_t i) { jobs[i](); });
 
   return std::make_pair(result, rand);
 }
 
+template <size_t N>
+static void append_points(std::vector<const g1_t*> &points, const G1Vec<N> &vect)
+{
+  for (size_t i = 0; i < N; i++) points.push_back(&vect.data()[i]);
+}
+
+void KPABE_DPVS_PUBLIC_KEY::append_points(std::vector<const g1_t*> &points) const
+{
+  ::append_points(points, this->d1); ::append_points(points, this->d3);
+  ::append_points(points, this->f1); ::append_points(points, this->f2); ::append_points(points, this->f3);
+  ::append_points(points, this->g1); ::append_points(points, this->g2);
+  ::append_points(points, this->h1); ::append_points(points, this->h2); ::append_points(points, this->h3);
+}
+
+#define KPABE_DERIVED_KEY_CHECK_BITS  128
+
+/*
+ * With random 128-bit scalars r_i, other_i = k * this_i for all i if
+ * sum(r_i * other_i) = k * sum(r_i * this_i): two multi-scalar multiplications
+ * and one multiplication by k, instead of one multiplication by k per point.
+ * The points of other must be in G1 for the combination to be sound, they are
+ * checked one by one first (see subgroup_check.hpp). G1 has a prime order, so
+ * if other_j != k * this_j, a single value of r_j modulo the order makes the
+ * sums equal: a wrong key passes with probability at most 2^-127.
+ */
 bool KPABE_DPVS_PUBLIC_KEY::validate_derived_key(const KPABE_DPVS_PUBLIC_KEY &other, const ZP k) const
 {
-  return (this->d1 * k == other.d1 && this->d3 * k == other.d3 &&
-          this->f1 * k == other.f1 && this->f2 * k == other.f2 && this->f3 * k == other.f3 &&
-          this->g1 * k == other.g1 && this->g2 * k == other.g2 &&
-          this->h1 * k == other.h1 && this->h2 * k == other.h2 && this->h3 * k == other.h3);
+  std::vector<const g1_t*> points, other_points;
+  this->append_points(points);
+  other.append_points(other_points);
+  const size_t n = points.size();
+
+  G1SubgroupBatch batch;
+  batch.add(other.d1); batch.add(other.d3);
+  batch.add(other.f1); batch.add(other.f2); batch.add(other.f3);
+  batch.add(other.g1); batch.add(other.g2);
+  batch.add(other.h1); batch.add(other.h2); batch.add(other.h3);
+  if (!batch.verify()) return false;
+
+  bool is_derived = false;
+  std::vector<g1_t> base(n), derived(n);
+  std::vector<bn_t> r(n);
+  g1_t sum, other_sum;
+
+  g1_null(sum); g1_null(other_sum);
+  for (size_t i = 0; i < n; i++) {
+    g1_null(base[i]); g1_null(derived[i]);
+    bn_null(r[i]);
+  }
+
+  RLC_TRY {
+    g1_new(sum); g1_new(other_sum);
+    for (size_t i = 0; i < n; i++) {
+      g1_new(base[i]); g1_new(derived[i]);
+      bn_new(r[i]);
+      g1_copy(base[i], *points[i]);
+      g1_copy(derived[i], *other_points[i]);
+      bn_rand(r[i], RLC_POS, KPABE_DERIVED_KEY_CHECK_BITS);
+    }
+
+    g1_mul_sim_lot(sum, base.data(), r.data(), n);
+    g1_mul_sim_lot(other_sum, derived.data(), r.data(), n);
+    g1_mul(sum, sum, k.m_ZP);
+    is_derived = (g1_cmp(sum, other_sum) == RLC_EQ);
+  }
+  RLC_CATCH_ANY {
+    is_derived = false;
+  }
+  RLC_FINALLY {
+    g1_free(sum); g1_free(other_sum);
+    for (size_t i = 0; i < n; i++) {
+      g1_free(base[i]); g1_free(derived[i]);
+      bn_free(r[i]);
+    }
+  }
+
+  return is_derived;
 }
 
 void KPABE_DPVS_PUBLIC_KEY::serialize(ByteString &output) const {
@@ -65,60 +160,67 @@ void KPABE_DPVS_PUBLIC_KEY::serialize(ByteString &output) const {
 
   result.insertFirstByte(KPABE_PUBLIC_KEY);
 
-  this->d1.serialize(temp); result.smartPack(temp);
-  this->d3.serialize(temp); result.smartPack(temp);
+  this->d1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->d3.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->f1.serialize(temp); result.smartPack(temp);
-  this->f2.serialize(temp); result.smartPack(temp);
-  this->f3.serialize(temp); result.smartPack(temp);
+  this->f1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->f2.serialize(temp, this->compressed); result.smartPack(temp);
+  this->f3.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->g1.serialize(temp); result.smartPack(temp);
-  this->g2.serialize(temp); result.smartPack(temp);
+  this->g1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->g2.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->h1.serialize(temp); result.smartPack(temp);
-  this->h2.serialize(temp); result.smartPack(temp);
-  this->h3.serialize(temp); result.smartPack(temp);
+  this->h1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->h2.serialize(temp, this->compressed); result.smartPack(temp);
+  this->h3.serialize(temp, this->compressed); result.smartPack(temp);
 
   // output.smartPack(result);
   result.serialize(output);
 }
 
+void KPABE_DPVS_PUBLIC_KEY::serialize(ByteWriter &writer) const {
+  writer.putHeader(this->getSizeInBytes() - hdrLen);
+  writer.put8(KPABE_PUBLIC_KEY);
+
+  bool cp = this->compressed;
+  writer.putVector(this->d1, cp); writer.putVector(this->d3, cp);
+  writer.putVector(this->f1, cp); writer.putVector(this->f2, cp); writer.putVector(this->f3, cp);
+  writer.putVector(this->g1, cp); writer.putVector(this->g2, cp);
+  writer.putVector(this->h1, cp); writer.putVector(this->h2, cp); writer.putVector(this->h3, cp);
+}
+
 void KPABE_DPVS_PUBLIC_KEY::deserialize(ByteString &input) {
-  ByteString temp;
-  size_t index = 0;
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
 
-  if (input.at(index++) != BYTESTRING || input.size() - input.get32bits(&index) < hdrLen) {
+void KPABE_DPVS_PUBLIC_KEY::deserialize(ByteReader &reader) {
+  if (!reader.getHeader()) {
     std::cerr << "Error: Invalid input" << std::endl;
     return;
   }
 
-  if (input.at(index++) != KPABE_PUBLIC_KEY) {
+  if (reader.get8() != KPABE_PUBLIC_KEY) {
     std::cerr << "Error: Invalid public key type" << std::endl;
     return;
   }
 
-  temp = input.smartUnpack(&index); this->d1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->d3.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->f1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->f2.deserialize(temp);
-  temp = input.smartUnpack(&index); this->f3.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->g1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->g2.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->h1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->h2.deserialize(temp);
-  temp = input.smartUnpack(&index); this->h3.deserialize(temp);
+  // The first vector gives the encoding of the points, the others must follow it
+  this->compressed = reader.getVector(this->d1);
+  bool cp = this->compressed;
+  reader.getVector(this->d3, cp);
+  reader.getVector(this->f1, cp); reader.getVector(this->f2, cp); reader.getVector(this->f3, cp);
+  reader.getVector(this->g1, cp); reader.getVector(this->g2, cp);
+  reader.getVector(this->h1, cp); reader.getVector(this->h2, cp); reader.getVector(this->h3, cp);
 }
 
 size_t KPABE_DPVS_PUBLIC_KEY::getSizeInBytes() const {
   size_t total_size = hdrLen;
 
-  size_t sd1 = this->d1.getSizeInBytes();
-  size_t sf1 = this->f1.getSizeInBytes();
-  size_t sg1 = this->g1.getSizeInBytes();
-  size_t sh1 = this->h1.getSizeInBytes();
+  size_t sd1 = this->d1.getSizeInBytes(this->compressed);
+  size_t sf1 = this->f1.getSizeInBytes(this->compressed);
+  size_t sg1 = this->g1.getSizeInBytes(this->compressed);
+  size_t sh1 = this->h1.getSizeInBytes(this->compressed);
 
   total_size +=(sd1 + smart_sizeof(sd1)) * 2 + (sf1 + smart_sizeof(sf1)) * 3 +
                (sg1 + smart_sizeof(sg1)) * 2 + (sh1 + smart_sizeof(sh1)) * 3;
@@ -186,71 +288,88 @@ void KPABE_DPVS_MASTER_KEY::set_bases(const G2_VS_BASE base_DD,
   if (base_DD[0]->dim == ND && base_FF[0]->dim == NF &&
       base_GG[0]->dim == NG && base_HH[0]->dim == NH)
   {
-    this->dd1 = G2_VECTOR(base_DD[0]);
-    this->dd3 = G2_VECTOR(base_DD[2]);
+    this->dd1 = G2Vec<ND>(base_DD[0]);
+    this->dd3 = G2Vec<ND>(base_DD[2]);
+
+    this->ff1 = G2Vec<NF>(base_FF[0]);
+    this->ff2 = G2Vec<NF>(base_FF[1]);
+    this->ff3 = G2Vec<NF>(base_FF[2]);
 
-    this->ff1 = G2_VECTOR(base_FF[0]);
-    this->ff2 = G2_VECTOR(base_FF[1]);
-    this->ff3 = G2_VECTOR(base_FF[2]);
+    this->gg1 = G2Vec<NG>(base_GG[0]);
+    this->gg2 = G2Vec<NG>(base_GG[1]);
 
-    this->gg1 = G2_VECTOR(base_GG[0]);
-    this->gg2 = G2_VECTOR(base_GG[1]);
+    this->hh1 = G2Vec<NH>(base_HH[0]);
+    this->hh2 = G2Vec<NH>(base_HH[1]);
+    this->hh3 = G2Vec<NH>(base_HH[2]);
 
-    this->hh1 = G2_VECTOR(base_HH[0]);
-    this->hh2 = G2_VECTOR(base_HH[1]);
-    this->hh3 = G2_VECTOR(base_HH[2]);
+    this->normalize();
   }
 }
 
+void KPABE_DPVS_MASTER_KEY::normalize()
+{
+  this->dd1.normalize(); this->dd3.normalize();
+  this->ff1.normalize(); this->ff2.normalize(); this->ff3.normalize();
+  this->gg1.normalize(); this->gg2.normalize();
+  this->hh1.normalize(); this->hh2.normalize(); this->hh3.normalize();
+}
+
 void KPABE_DPVS_MASTER_KEY::serialize(ByteString &output) const {
   ByteString temp, result;
 
   result.insertFirstByte(KPABE_MASTER_KEY);
 
-  this->dd1.serialize(temp); result.smartPack(temp);
-  this->dd3.serialize(temp); result.smartPack(temp);
+  this->dd1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->dd3.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->ff1.serialize(temp); result.smartPack(temp);
-  this->ff2.serialize(temp); result.smartPack(temp);
-  this->ff3.serialize(temp); result.smartPack(temp);
+  this->ff1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->ff2.serialize(temp, this->compressed); result.smartPack(temp);
+  this->ff3.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->gg1.serialize(temp); result.smartPack(temp);
-  this->gg2.serialize(temp); result.smartPack(temp);
+  this->gg1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->gg2.serialize(temp, this->compressed); result.smartPack(temp);
 
-  this->hh1.serialize(temp); result.smartPack(temp);
-  this->hh2.serialize(temp); result.smartPack(temp);
-  this->hh3.serialize(temp); result.smartPack(temp);
+  this->hh1.serialize(temp, this->compressed); result.smartPack(temp);
+  this->hh2.serialize(temp, this->compressed); result.smartPack(temp);
+  this->hh3.serialize(temp, this->compressed); result.smartPack(temp);
 
   result.serialize(output);
 }
 
+void KPABE_DPVS_MASTER_KEY::serialize(ByteWriter &writer) const {
+  writer.putHeader(this->getSizeInBytes() - hdrLen);
+  writer.put8(KPABE_MASTER_KEY);
+
+  bool cp = this->compressed;
+  writer.putVector(this->dd1, cp); writer.putVector(this->dd3, cp);
+  writer.putVector(this->ff1, cp); writer.putVector(this->ff2, cp); writer.putVector(this->ff3, cp);
+  writer.putVector(this->gg1, cp); writer.putVector(this->gg2, cp);
+  writer.putVector(this->hh1, cp); writer.putVector(this->hh2, cp); writer.putVector(this->hh3, cp);
+}
+
 void KPABE_DPVS_MASTER_KEY::deserialize(ByteString &input) {
-  ByteString temp;
-  size_t index = 0;
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
 
-  if (input.at(index++) != BYTESTRING || input.size() - input.get32bits(&index) < hdrLen) {
+void KPABE_DPVS_MASTER_KEY::deserialize(ByteReader &reader) {
+  if (!reader.getHeader()) {
     std::cerr << "Error: Invalid input" << std::endl;
     return;
   }
 
-  if (input.at(index++) != KPABE_MASTER_KEY) {
+  if (reader.get8() != KPABE_MASTER_KEY) {
     std::cerr << "Error: Invalid master key type" << std::endl;
     return;
   }
 
-  temp = input.smartUnpack(&index); this->dd1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->dd3.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->ff1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->ff2.deserialize(temp);
-  temp = input.smartUnpack(&index); this->ff3.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->gg1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->gg2.deserialize(temp);
-
-  temp = input.smartUnpack(&index); this->hh1.deserialize(temp);
-  temp = input.smartUnpack(&index); this->hh2.deserialize(temp);
-  temp = input.smartUnpack(&index); this->hh3.deserialize(temp);
+  // The first vector gives the encoding of the points, the others must follow it
+  this->compressed = reader.getVector(this->dd1);
+  bool cp = this->compressed;
+  reader.getVector(this->dd3, cp);
+  reader.getVector(this->ff1, cp); reader.getVector(this->ff2, cp); reader.getVector(this->ff3, cp);
+  reader.getVector(this->gg1, cp); reader.getVector(this->gg2, cp);
+  reader.getVector(this->hh1, cp); reader.getVector(this->hh2, cp); reader.getVector(this->hh3, cp);
 }
 
 #if 0
@@ -302,10 +421,10 @@ void KPABE_DPVS_MASTER_KEY::deserialize(const std::vector<uint8_t> &buffer) {
 size_t KPABE_DPVS_MASTER_KEY::getSizeInBytes() const {
   size_t total_size = 0;
 
-  size_t sd1 = this->dd1.getSizeInBytes();
-  size_t sf1 = this->ff1.getSizeInBytes();
-  size_t sg1 = this->gg1.getSizeInBytes();
-  size_t sh1 = this->hh1.getSizeInBytes();
+  size_t sd1 = this->dd1.getSizeInBytes(this->compressed);
+  size_t sf1 = this->ff1.getSizeInBytes(this->compressed);
+  size_t sg1 = this->gg1.getSizeInBytes(this->compressed);
+  size_t sh1 = this->hh1.getSizeInBytes(this->compressed);
 
   total_size = (sd1 + smart_sizeof(sd1)) * 2 + (sf1 + smart_sizeof(sf1)) * 3 +
                (sg1 + smart_sizeof(sg1)) * 2 + (sh1 + smart_sizeof(sh1)) * 3;
@@ -374,6 +493,10 @@ bool KPABE_DPVS_DECRYPTION_KEY::generate(const KPABE_DPVS_MASTER_KEY &master_key
     std::cerr << "Error: Could not create policy tree" << std::endl;
     return false;
   }
+  if (!this->program.compile(*policy_tree)) {
+    std::cerr << "Error: Could not compile the policy" << std::endl;
+    return false;
+  }
 
   // Generate random values for ri
   uint size_bl = this->black_list.size();
@@ -395,12 +518,29 @@ bool KPABE_DPVS_DECRYPTION_KEY::generate(const KPABE_DPVS_MASTER_KEY &master_key
   lsss.shareSecret(policy_tree.get(), secret_y2);
   OpenABELSSSRowMap secret_shares = lsss.getRows();
 
+  this->clear_pending();
+
   /* set key_root : -y0 * msk->dd1 + msk->dd3 */
   this->key_root = master_key.get_dd1() * (-y0) + master_key.get_dd3();
 
+  // The urls are hashed in one batch, they are not interned: only the labels
+  // of the policy, not seen yet, are added to the interner in one batch
+  std::vector<std::string> urls(this->white_list.begin(), this->white_list.end());
+  urls.insert(urls.end(), this->black_list.begin(), this->black_list.end());
+  std::vector<ZP> urls_zp = hashToZP(urls, group.order);
+
+  AttributeInterner& interner = AttributeInterner::global();
+  std::vector<std::string> names;
+  for (auto it = secret_shares.begin(); it != secret_shares.end(); ++it) {
+    names.push_back(it->second.label());
+    names.push_back(it->first);
+  }
+  interner.intern_all(names);
+
   /* set key_wl : msk->ff1 * (theta_j * url_j) + msk->ff2 * (-theta_j) + msk->ff3 * y0 */
+  auto url_zp = urls_zp.begin();
   for (const auto& url_wl : this->white_list) {
-    url = hashToZP(url_wl, group.order);
+    url = *url_zp++;
     theta_j.setRandom(group.order);
 
     this->key_wl[url_wl] = master_key.get_ff1() * (theta_j * url) +
@@ -411,7 +551,7 @@ bool KPABE_DPVS_DECRYPTION_KEY::generate(const KPABE_DPVS_MASTER_KEY &master_key
   /* set key_bl : msk->gg1 * (url_bl[i] * ri[i]) + msk->gg2 * (-ri[i]) */
   uint i = 0;
   for (const auto &url_bl : this->black_list) {
-    url = hashToZP(url_bl, group.order);
+    url = *url_zp++;
 
     this->key_bl[url_bl] = master_key.get_gg1() * (url * ri.at(i)) +
                            master_key.get_gg2() * (-ri.at(i));
@@ -425,91 +565,493 @@ bool KPABE_DPVS_DECRYPTION_KEY::generate(const KPABE_DPVS_MASTER_KEY &master_key
     aj = it->second.element();
     aj.setOrder(group.order);
 
-    att_j = hashToZP(it->second.label(), group.order);
+    att_j = interner.intern(it->second.label()).zp;
     theta_j.setRandom(group.order);
 
-    std::string attr_key = OpenABEHashKey(it->first);
+    const std::string& attr_key = interner.intern(it->first).hash_key;
     this->key_att[attr_key] = master_key.get_hh1() * (att_j * theta_j) +
                          master_key.get_hh2() * (-theta_j) +
                          master_key.get_hh3() * aj;
   }
 
+  this->normalize();
+
   return true;
 }
 
+void KPABE_DPVS_DECRYPTION_KEY::normalize()
+{
+  this->key_root.normalize();
+  for (auto& [_, key] : this->key_wl) key.normalize();
+  for (auto& [_, key] : this->key_bl) key.normalize();
+  for (auto& [_, key] : this->key_att) key.normalize();
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::set_lazy_decoding(bool lazy, size_t cache_size)
+{
+  this->lazy_decoding = lazy;
+  this->wl_cache.reset(lazy ? cache_size : 0);
+  this->att_cache.reset(lazy ? cache_size : 0);
+  if (!lazy && this->has_pending()) {
+    this->decode_pending();
+    this->check_points();
+  }
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::set_compression(bool compressed)
+{
+  if (compressed != this->compressed && this->has_pending()) {
+    this->decode_pending();
+    this->check_points();
+  }
+  this->compressed = compressed;
+}
+
+template <class Vec>
+static Vec decode_vector(const std::vector<uint8_t> &encoded, size_t offset)
+{
+  Vec vect;
+  ByteReader reader({encoded.data() + offset, encoded.size() - offset});
+  vect.deserialize(reader);
+  return vect;
+}
+
+// An entry decoded on demand is checked alone
+template <class Vec>
+static std::shared_ptr<const Vec> decode_checked(const std::vector<uint8_t> &encoded, size_t offset,
+                                                 bool validate)
+{
+  auto vect = std::make_shared<const Vec>(decode_vector<Vec>(encoded, offset));
+  if (validate) {
+    G2SubgroupBatch batch;
+    batch.add(*vect);
+    if (!batch.verify()) throw std::runtime_error("Decryption key point not in G2");
+  }
+  return vect;
+}
+
+/*
+ * Entries decoded on demand are shared with the cache. The entries of the
+ * maps are returned without copy, they live as long as the key.
+ */
+std::shared_ptr<const G2Vec<NF>> KPABE_DPVS_DECRYPTION_KEY::get_key_wl(const std::string &url) const
+{
+  auto it = this->key_wl.find(url);
+  if (it != this->key_wl.end()) {
+    return std::shared_ptr<const G2Vec<NF>>(std::shared_ptr<void>(), &it->second);
+  }
+
+  auto pending = this->encoded_wl.find(url);
+  if (pending == this->encoded_wl.end()) return nullptr;
+
+  return this->wl_cache.get(url, [&]() {
+    return decode_checked<G2Vec<NF>>(this->encoded, pending->second, this->validate_points);
+  });
+}
+
+std::shared_ptr<const G2Vec<NH>> KPABE_DPVS_DECRYPTION_KEY::get_key_att(const std::string &att) const
+{
+  auto it = this->key_att.find(att);
+  if (it != this->key_att.end()) {
+    return std::shared_ptr<const G2Vec<NH>>(std::shared_ptr<void>(), &it->second);
+  }
+
+  auto pending = this->encoded_att.find(att);
+  if (pending == this->encoded_att.end()) return nullptr;
+
+  return this->att_cache.get(att, [&]() {
+    return decode_checked<G2Vec<NH>>(this->encoded, pending->second, this->validate_points);
+  });
+}
+
+/*
+ * Decode the pending entries on the thread pool, one job per vector. The
+ * entries of the maps are created first, the jobs only fill them. encoded_bl
+ * holds the black list entries of a parallel deserialize.
+ */
+void KPABE_DPVS_DECRYPTION_KEY::decode_pending(const std::map<std::string, size_t>& encoded_bl)
+{
+  std::vector<std::pair<G2Vec<NF>*, size_t>> wl;
+  std::vector<std::pair<G2Vec<NG>*, size_t>> bl;
+  std::vector<std::pair<G2Vec<NH>*, size_t>> att;
+
+  for (const auto& [url, offset] : this->encoded_wl) wl.emplace_back(&this->key_wl[url], offset);
+  for (const auto& [url, offset] : encoded_bl) bl.emplace_back(&this->key_bl[url], offset);
+  for (const auto& [att_name, offset] : this->encoded_att) att.emplace_back(&this->key_att[att_name], offset);
+
+  ThreadPool::global().parallel_for(wl.size() + bl.size() + att.size(), [&](size_t i) {
+    if (i < wl.size()) {
+      *wl[i].first = decode_vector<G2Vec<NF>>(this->encoded, wl[i].second);
+    } else if ((i -= wl.size()) < bl.size()) {
+      *bl[i].first = decode_vector<G2Vec<NG>>(this->encoded, bl[i].second);
+    } else {
+      i -= bl.size();
+      *att[i].first = decode_vector<G2Vec<NH>>(this->encoded, att[i].second);
+    }
+  });
+  this->clear_pending();
+}
+
+/* Entries still pending are checked when they are decoded */
+bool KPABE_DPVS_DECRYPTION_KEY::is_valid() const
+{
+  G2SubgroupBatch batch;
+  batch.add(this->key_root);
+  for (const auto& [_, key] : this->key_wl) batch.add(key);
+  for (const auto& [_, key] : this->key_bl) batch.add(key);
+  for (const auto& [_, key] : this->key_att) batch.add(key);
+  return batch.verify();
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::check_points() const
+{
+  if (this->validate_points && !this->is_valid()) {
+    throw std::runtime_error("Decryption key point not in G2");
+  }
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::clear_pending()
+{
+  this->encoded.clear();
+  this->encoded.shrink_to_fit();
+  this->encoded_wl.clear();
+  this->encoded_att.clear();
+  this->wl_cache.clear();
+  this->att_cache.clear();
+}
+
 void KPABE_DPVS_DECRYPTION_KEY::serialize(ByteString &output) const {
   ByteString temp, result;
 
   result.insertFirstByte(KPABE_DECRYPTION_KEY);
 
   temp.fromString(this->policy);  result.smartPack(temp);
-  this->key_root.serialize(temp); result.smartPack(temp);
+  this->key_root.serialize(temp, this->compressed); result.smartPack(temp);
 
-  uint16_t key_wl_size = this->key_wl.size();
+  uint16_t key_wl_size = count_v1(this->key_wl.size() + this->encoded_wl.size());
   result.pack16bits(key_wl_size);
   for (const auto& [key, value] : this->key_wl) {
     temp.fromString(key);  result.smartPack(temp);
-    value.serialize(temp); result.smartPack(temp);
+    value.serialize(temp, this->compressed); result.smartPack(temp);
+  }
+  for (const auto& [key, offset] : this->encoded_wl) {
+    temp.fromString(key);  result.smartPack(temp);
+    temp.clear(); temp.appendArray(&this->encoded[offset], G2Vec<NF>::getEncodedSize(this->compressed));
+    result.smartPack(temp);
   }
 
-  uint16_t key_bl_size = this->key_bl.size();
+  uint16_t key_bl_size = count_v1(this->key_bl.size());
   result.pack16bits(key_bl_size);
   for (const auto& [key, value] : this->key_bl) {
     temp.fromString(key);  result.smartPack(temp);
-    value.serialize(temp); result.smartPack(temp);
+    value.serialize(temp, this->compressed); result.smartPack(temp);
   }
 
-  uint16_t key_att_size = this->key_att.size();
+  uint16_t key_att_size = count_v1(this->key_att.size() + this->encoded_att.size());
   result.pack16bits(key_att_size);
   for (const auto& [key, value] : this->key_att) {
     temp.fromString(key);  result.smartPack(temp);
-    value.serialize(temp); result.smartPack(temp);
+    value.serialize(temp, this->compressed); result.smartPack(temp);
+  }
+  for (const auto& [key, offset] : this->encoded_att) {
+    temp.fromString(key);  result.smartPack(temp);
+    temp.clear(); temp.appendArray(&this->encoded[offset], G2Vec<NH>::getEncodedSize(this->compressed));
+    result.smartPack(temp);
   }
 
   result.serialize(output);
 }
 
+void KPABE_DPVS_DECRYPTION_KEY::serialize(ByteWriter &writer) const {
+  writer.putHeader(this->getSizeInBytes() - hdrLen);
+  writer.put8(KPABE_DECRYPTION_KEY);
+
+  writer.putString(this->policy);
+  writer.putVector(this->key_root, this->compressed);
+
+  writer.put16(count_v1(this->key_wl.size() + this->encoded_wl.size()));
+  for (const auto& [key, value] : this->key_wl) {
+    writer.putString(key); writer.putVector(value, this->compressed);
+  }
+  for (const auto& [key, offset] : this->encoded_wl) {
+    writer.putString(key);
+    writer.putPackHeader(G2Vec<NF>::getEncodedSize(this->compressed));
+    writer.putBytes(&this->encoded[offset], G2Vec<NF>::getEncodedSize(this->compressed));
+  }
+
+  writer.put16(count_v1(this->key_bl.size()));
+  for (const auto& [key, value] : this->key_bl) {
+    writer.putString(key); writer.putVector(value, this->compressed);
+  }
+
+  writer.put16(count_v1(this->key_att.size() + this->encoded_att.size()));
+  for (const auto& [key, value] : this->key_att) {
+    writer.putString(key); writer.putVector(value, this->compressed);
+  }
+  for (const auto& [key, offset] : this->encoded_att) {
+    writer.putString(key);
+    writer.putPackHeader(G2Vec<NH>::getEncodedSize(this->compressed));
+    writer.putBytes(&this->encoded[offset], G2Vec<NH>::getEncodedSize(this->compressed));
+  }
+}
+
 void KPABE_DPVS_DECRYPTION_KEY::deserialize(ByteString &input) {
-  ByteString temp;
-  size_t index = 0;
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
+
+/* Copy the encoding of a vector to encoded, its points are checked on decoding */
+template <class Vec>
+size_t KPABE_DPVS_DECRYPTION_KEY::keep_encoded(ByteReader &reader) {
+  size_t len = reader.getPackHeader();
+  if (len != Vec::getEncodedSize(this->compressed)) {
+    throw std::runtime_error("Invalid vector size");
+  }
+
+  const uint8_t *bytes = reader.advance(len);
+  uint8_t type = this->compressed ? VECTOR_G2_ELEMENT : VECTOR_G2_ELEMENT_UNCOMPRESSED;
+  if (bytes[0] != type || bytes[1] != Vec::getDim()) {
+    throw std::runtime_error("Invalid G2 vector type or dimension");
+  }
+
+  size_t offset = this->encoded.size();
+  this->encoded.insert(this->encoded.end(), bytes, bytes + len);
+  return offset;
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::deserialize(ByteReader &reader) {
   std::string key_str;
 
-  // S'il n'y avait pas le cas 'oversized' dans custom stream, on aurait pu faire
-  // bytes.deserialize(input); // deserialize the input in bytes
-  // Et utiliser bytes (à la place de input) pour le reste du code
-  if (input.at(index++) != BYTESTRING || input.size() - input.get32bits(&index) < hdrLen) {
+  if (reader.remaining() > 0 && reader.peek8() == KPABE_FORMAT_V2) {
+    this->decodeV2(reader);
+    return;
+  }
+
+  if (!reader.getHeader()) {
     std::cerr << "Error: Invalid input" << std::endl;
     return;
   }
 
-  if (input.at(index++) != KPABE_DECRYPTION_KEY) {
+  if (reader.get8() != KPABE_DECRYPTION_KEY) {
     std::cerr << "Error: Invalid decryption key type" << std::endl;
     return;
   }
 
-  temp = input.smartUnpack(&index);
-  this->policy = temp.toString();
-  temp = input.smartUnpack(&index); this->key_root.deserialize(temp);
+  this->policy = reader.getString();
+  this->program.compile(this->policy);
+  // key_root gives the encoding of the points, the other vectors must follow it
+  this->compressed = reader.getVector(this->key_root);
+
+  // Parallel decoding keeps every entry encoded, then decodes them at once
+  bool deferred = this->parallel_decoding && !this->lazy_decoding;
+  bool keep = this->lazy_decoding || deferred;
+  std::map<std::string, size_t> encoded_bl;
+
+  this->key_wl.clear();
+  this->clear_pending();
+  if (keep) {
+    // Upper bound of the size of the encoded vectors
+    this->encoded.reserve(reader.remaining());
+  }
 
-  uint16_t key_wl_size = input.get16bits(&index);
+  uint16_t key_wl_size = reader.get16();
   for (uint16_t i = 0; i < key_wl_size; i++) {
-    temp = input.smartUnpack(&index); key_str = temp.toString();
-    temp = input.smartUnpack(&index); this->key_wl[key_str].deserialize(temp);
+    key_str = reader.getString();
+    if (keep)
+      this->encoded_wl[key_str] = this->keep_encoded<G2Vec<NF>>(reader);
+    else
+      reader.getVector(this->key_wl[key_str], this->compressed);
   }
 
-  uint16_t key_bl_size = input.get16bits(&index);
+  this->key_bl.clear();
+  uint16_t key_bl_size = reader.get16();
   for (uint16_t i = 0; i < key_bl_size; i++) {
-    temp = input.smartUnpack(&index); key_str = temp.toString();
-    temp = input.smartUnpack(&index); this->key_bl[key_str].deserialize(temp);
+    key_str = reader.getString();
+    if (deferred)
+      encoded_bl[key_str] = this->keep_encoded<G2Vec<NG>>(reader);
+    else
+      reader.getVector(this->key_bl[key_str], this->compressed);
   }
 
-  uint16_t key_att_size = input.get16bits(&index);
+  this->key_att.clear();
+  uint16_t key_att_size = reader.get16();
   for (uint16_t i = 0; i < key_att_size; i++) {
-    temp = input.smartUnpack(&index); key_str = temp.toString();
-    temp = input.smartUnpack(&index); this->key_att[key_str].deserialize(temp);
+    key_str = reader.getString();
+    if (keep)
+      this->encoded_att[key_str] = this->keep_encoded<G2Vec<NH>>(reader);
+    else
+      reader.getVector(this->key_att[key_str], this->compressed);
+  }
+
+  if (deferred) this->decode_pending(encoded_bl);
+  this->check_points();
+}
+
+/* Copy bare points to encoded, in the layout kept by keep_encoded */
+template <class Vec>
+size_t KPABE_DPVS_DECRYPTION_KEY::keep_points(ByteReader &points) {
+  size_t len = Vec::getEncodedSize(this->compressed);
+  size_t offset = this->encoded.size();
+  this->encoded.resize(offset + len);
+
+  ByteWriter writer({this->encoded.data() + offset, len});
+  writer.put8(this->compressed ? VECTOR_G2_ELEMENT : VECTOR_G2_ELEMENT_UNCOMPRESSED);
+  writer.put8(Vec::getDim());
+  size_t points_size = points.remaining();
+  writer.putPackHeader(points_size);
+  writer.putBytes(points.advance(points_size), points_size);
+  return offset;
+}
+
+template <class Sink>
+void KPABE_DPVS_DECRYPTION_KEY::encodeV2(Sink &sink) const {
+  bool cp = this->compressed;
+  size_t ps = G2Vec<ND>::getPointSize(cp);
+
+  put_header_v2(sink, KPABE_DECRYPTION_KEY, cp, {ND, NF, NG, NH});
+  {
+    ByteWriter writer = next_entry_v2(sink, this->policy, ND * ps);
+    this->key_root.serializePoints(writer, cp);
+  }
+
+  // Pending entries are copied as they are, after their vector header
+  size_t wl_header = G2Vec<NF>::getEncodedSize(cp) - NF * ps;
+  put_count_v2(sink, this->key_wl.size() + this->encoded_wl.size());
+  for (const auto& [key, value] : this->key_wl) {
+    ByteWriter writer = next_entry_v2(sink, key, NF * ps);
+    value.serializePoints(writer, cp);
+  }
+  for (const auto& [key, offset] : this->encoded_wl) {
+    ByteWriter writer = next_entry_v2(sink, key, NF * ps);
+    writer.putBytes(&this->encoded[offset + wl_header], NF * ps);
+  }
+
+  put_count_v2(sink, this->key_bl.size());
+  for (const auto& [key, value] : this->key_bl) {
+    ByteWriter writer = next_entry_v2(sink, key, NG * ps);
+    value.serializePoints(writer, cp);
+  }
+
+  size_t att_header = G2Vec<NH>::getEncodedSize(cp) - NH * ps;
+  put_count_v2(sink, this->key_att.size() + this->encoded_att.size());
+  for (const auto& [key, value] : this->key_att) {
+    ByteWriter writer = next_entry_v2(sink, key, NH * ps);
+    value.serializePoints(writer, cp);
+  }
+  for (const auto& [key, offset] : this->encoded_att) {
+    ByteWriter writer = next_entry_v2(sink, key, NH * ps);
+    writer.putBytes(&this->encoded[offset + att_header], NH * ps);
+  }
+}
+
+template <class Source>
+void KPABE_DPVS_DECRYPTION_KEY::decodeV2(Source &source) {
+  bool cp;
+  if (!get_header_v2(source, KPABE_DECRYPTION_KEY, &cp, {ND, NF, NG, NH})) {
+    std::cerr << "Error: Invalid decryption key type or dimensions" << std::endl;
+    return;
+  }
+  this->compressed = cp;
+  size_t ps = G2Vec<ND>::getPointSize(cp);
+
+  this->policy = get_string_v2(source);
+  this->program.compile(this->policy);
+  {
+    ByteReader points = source.next(ND * ps);
+    this->key_root.deserializePoints(points, cp);
+  }
+
+  bool deferred = this->parallel_decoding && !this->lazy_decoding;
+  bool keep = this->lazy_decoding || deferred;
+  std::map<std::string, size_t> encoded_bl;
+
+  this->key_wl.clear();
+  this->key_bl.clear();
+  this->key_att.clear();
+  this->clear_pending();
+
+  // A parallel decoding buffers at most KPABE_DECODE_CHUNK entries
+  size_t nb_deferred = 0;
+  auto next_deferred = [&]() {
+    if (++nb_deferred % KPABE_DECODE_CHUNK == 0) {
+      this->decode_pending(encoded_bl);
+      encoded_bl.clear();
+    }
+  };
+
+  uint64_t nb_wl = source.getVarint();
+  for (uint64_t i = 0; i < nb_wl; i++) {
+    std::string url = get_string_v2(source);
+    ByteReader points = source.next(NF * ps);
+    if (keep)
+      this->encoded_wl[url] = this->keep_points<G2Vec<NF>>(points);
+    else
+      this->key_wl[url].deserializePoints(points, cp);
+    if (deferred) next_deferred();
+  }
+
+  uint64_t nb_bl = source.getVarint();
+  for (uint64_t i = 0; i < nb_bl; i++) {
+    std::string url = get_string_v2(source);
+    ByteReader points = source.next(NG * ps);
+    if (deferred)
+      encoded_bl[url] = this->keep_points<G2Vec<NG>>(points);
+    else
+      this->key_bl[url].deserializePoints(points, cp);
+    if (deferred) next_deferred();
+  }
+
+  uint64_t nb_att = source.getVarint();
+  for (uint64_t i = 0; i < nb_att; i++) {
+    std::string att = get_string_v2(source);
+    ByteReader points = source.next(NH * ps);
+    if (keep)
+      this->encoded_att[att] = this->keep_points<G2Vec<NH>>(points);
+    else
+      this->key_att[att].deserializePoints(points, cp);
+    if (deferred) next_deferred();
+  }
+
+  if (deferred) this->decode_pending(encoded_bl);
+  this->check_points();
+}
+
+size_t KPABE_DPVS_DECRYPTION_KEY::getSizeInBytesV2() const {
+  size_t ps = G2Vec<ND>::getPointSize(this->compressed);
+  size_t nb_wl = this->key_wl.size() + this->encoded_wl.size();
+  size_t nb_att = this->key_att.size() + this->encoded_att.size();
+
+  size_t total_size = 3 + varint_size(ND) + varint_size(NF) + varint_size(NG) + varint_size(NH)
+                    + entry_size_v2(this->policy, ND * ps)
+                    + varint_size(nb_wl) + varint_size(this->key_bl.size()) + varint_size(nb_att);
+
+  for (const auto& [wl, _] : this->key_wl) total_size += entry_size_v2(wl, NF * ps);
+  for (const auto& [wl, _] : this->encoded_wl) total_size += entry_size_v2(wl, NF * ps);
+  for (const auto& [bl, _] : this->key_bl) total_size += entry_size_v2(bl, NG * ps);
+  for (const auto& [att, _] : this->key_att) total_size += entry_size_v2(att, NH * ps);
+  for (const auto& [att, _] : this->encoded_att) total_size += entry_size_v2(att, NH * ps);
+
+  return total_size;
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::serializeV2(std::ostream &os) const {
+  StreamWriter writer(os);
+  this->encodeV2(writer);
+}
+
+void KPABE_DPVS_DECRYPTION_KEY::serializeV2(std::vector<uint8_t> &buffer) const {
+  buffer.resize(this->getSizeInBytesV2());
+  ByteWriter writer(buffer);
+  this->encodeV2(writer);
+  if (writer.size() != buffer.size()) {
+    throw std::logic_error("Serialized size differs from getSizeInBytesV2");
   }
 }
 
+void KPABE_DPVS_DECRYPTION_KEY::deserialize(StreamReader &reader) {
+  this->decodeV2(reader);
+}
+
 #if 0
 void KPABE_DPVS_DECRYPTION_KEY::serialize(std::ostream &os) const {
  if (os.good()) {
@@ -562,20 +1104,25 @@ size_t KPABE_DPVS_DECRYPTION_KEY::getSizeInBytes() const
   size_t total_size = hdrLen;
 
   size_t spol = this->policy.size();
-  size_t skr  = this->key_root.getSizeInBytes();
-  size_t skwl = this->key_wl.begin()->second.getSizeInBytes();
-  size_t skbl = this->key_bl.begin()->second.getSizeInBytes();
-  size_t skatt= this->key_att.begin()->second.getSizeInBytes();
+  size_t skr  = this->key_root.getSizeInBytes(this->compressed);
+  size_t skwl = G2Vec<NF>::getSizeInBytes(this->compressed);
+  size_t skbl = G2Vec<NG>::getSizeInBytes(this->compressed);
+  size_t skatt= G2Vec<NH>::getSizeInBytes(this->compressed);
 
   size_t s_wl = 0, s_bl = 0, s_att = 0;
   for (const auto& [wl, _] : this->key_wl) s_wl += wl.size() + smart_sizeof(wl.size());
+  for (const auto& [wl, _] : this->encoded_wl) s_wl += wl.size() + smart_sizeof(wl.size());
   for (const auto& [bl, _] : this->key_bl) s_bl += bl.size() + smart_sizeof(bl.size());
   for (const auto& [att, _] : this->key_att) s_att += att.size() + smart_sizeof(att.size());
+  for (const auto& [att, _] : this->encoded_att) s_att += att.size() + smart_sizeof(att.size());
+
+  size_t nb_wl = this->key_wl.size() + this->encoded_wl.size();
+  size_t nb_att = this->key_att.size() + this->encoded_att.size();
 
   total_size +=(spol + smart_sizeof(spol)) + (skr + smart_sizeof(skr) + 1) +
-               (skwl + smart_sizeof(skwl) + 1) * this->key_wl.size()  + s_wl +
-               (skbl + smart_sizeof(skbl) + 1) * this->key_bl.size()  + s_bl +
-               (skatt+ smart_sizeof(skatt)+ 1) * this->key_att.size() + s_att +
+               (skwl + smart_sizeof(skwl) + 1) * nb_wl + s_wl +
+               (skbl + smart_sizeof(skbl) + 1) * this->key_bl.size() + s_bl +
+               (skatt+ smart_sizeof(skatt)+ 1) * nb_att + s_att +
                 sizeof(uint8_t) + sizeof(uint16_t) * 3;
 
   return total_size;
@@ -583,6 +1130,16 @@ size_t KPABE_DPVS_DECRYPTION_KEY::getSizeInBytes() const
 
 bool KPABE_DPVS_DECRYPTION_KEY::operator==(const KPABE_DPVS_DECRYPTION_KEY &other) const
 {
+  // The encoding of a point is unique, so equal keys give equal bytes
+  bool is_pending = !this->encoded_wl.empty() || !this->encoded_att.empty() ||
+                    !other.encoded_wl.empty() || !other.encoded_att.empty();
+  if (is_pending) {
+    ByteString this_bytes, other_bytes;
+    this->serialize(this_bytes);
+    other.serialize(other_bytes);
+    return this_bytes == other_bytes;
+  }
+
   return this->policy == other.policy &&
          this->key_root == other.key_root &&
          map_compare(this->key_wl, other.key_wl) &&
@@ -7,6 +7,10 @@
  */
 
 #include "kpabe.hpp"
+#include "thread_pool.hpp"
+#include "subgroup_check.hpp"
+#include "attribute_interner.hpp"
+#include "policy_program.hpp"
 
 
 /**
@@ -29,6 +33,60 @@ KPABE_DPVS::KPABE_DPVS(const std::vector<std::string>& white_list, const std::ve
   }
 }
 
+/**
+ * @brief Generates several DPVS bases at once. The random matrices are sampled
+ *        sequentially, then every row of every base (and dual base) is lifted
+ *        in G1/G2 as an independent job of the global thread pool.
+ *
+ * @param[out] bases The generated bases, nullptr on failure
+ * @param[in]  dims  The dimension of each base
+ * @return true if all bases are generated, false otherwise
+ */
+static bool generate_dpvs_bases(std::vector<dpvs_t*>& bases, const std::vector<uint8_t>& dims)
+{
+  const size_t nb_bases = dims.size();
+  bool is_generated = true;
+
+  std::vector<mat_st> mats(nb_bases), dual_mats(nb_bases);
+  std::vector<std::pair<size_t, uint8_t>> rows;
+  dpvs_tables_t tables;
+
+  bases.assign(nb_bases, nullptr);
+
+  for (size_t k = 0; k < nb_bases; k++) {
+    mats[k].dim = dual_mats[k].dim = 0;
+    if ((bases[k] = dpvs_create_bases(dims[k])) == nullptr ||
+        !dpvs_gen_matrices(&mats[k], &dual_mats[k], dims[k])) {
+      is_generated = false;
+      break;
+    }
+    for (uint8_t i = 0; i < dims[k]; i++) rows.emplace_back(k, i);
+  }
+
+  if (is_generated && (is_generated = dpvs_tables_init(&tables))) {
+    // Two jobs per row: one in G1 (base), one in G2 (dual base)
+    ThreadPool::global().parallel_for(2 * rows.size(), [&](size_t job) {
+      auto [k, i] = rows[job / 2];
+      if (job % 2 == 0)
+        dpvs_set_base_row(bases[k], &mats[k], &tables, i);
+      else
+        dpvs_set_dual_base_row(bases[k], &dual_mats[k], &tables, i);
+    });
+    dpvs_tables_clear(&tables);
+  }
+
+  for (size_t k = 0; k < nb_bases; k++) {
+    mat_clear(&mats[k]);
+    mat_clear(&dual_mats[k]);
+    if (!is_generated) {
+      dpvs_clear(bases[k]);
+      bases[k] = nullptr;
+    }
+  }
+
+  return is_generated;
+}
+
 /**
  * @brief This method generates the public and master keys.
  * 
@@ -38,17 +96,15 @@ bool KPABE_DPVS::setup() {
 
   bool is_setup = false;
 
-  // Generate DPVS bases
-  dpvs_t *base_D = dpvs_generate_bases(ND);
-  dpvs_t *base_F = dpvs_generate_bases(NF);
-  dpvs_t *base_G = dpvs_generate_bases(NG);
-  dpvs_t *base_H = dpvs_generate_bases(NH);
-
-  if (base_D == nullptr || base_F == nullptr ||
-      base_G == nullptr || base_H == nullptr) {
+  // Generate DPVS bases D, F, G and H concurrently
+  std::vector<dpvs_t*> bases;
+  if (!generate_dpvs_bases(bases, {ND, NF, NG, NH})) {
     std::cerr << "Error: Could not generate DPVS bases" << std::endl;
   }
   else { 
+    dpvs_t *base_D = bases[0], *base_F = bases[1];
+    dpvs_t *base_G = bases[2], *base_H = bases[3];
+
     // Set public key
     public_key.set_bases(base_D->base, base_F->base,
                          base_G->base, base_H->base);
@@ -61,10 +117,7 @@ bool KPABE_DPVS::setup() {
   }
 
   // Clear bases
-  dpvs_clear(base_D);
-  dpvs_clear(base_F);
-  dpvs_clear(base_G);
-  dpvs_clear(base_H);
+  for (auto base : bases) dpvs_clear(base);
 
   return is_setup;
 }
@@ -143,26 +196,31 @@ bool KPABE_DPVS_CIPHERTEXT::encrypt(uint8_t* session_key, const KPABE_DPVS_PUBLI
 
   /* set ctx_att: for all att in attributes_list,
    *  pk->h1 * sigma_att + pk->h2 * (sigma_att * att) + omega * pk->h3 */
-  G1_VECTOR h3_times_omega = public_key.get_h3() * omega;
+  G1Vec<NH> h3_times_omega = public_key.get_h3() * omega;
+  AttributeInterner& interner = AttributeInterner::global();
+  this->ctx_att.reserve(attrList->size());
+  interner.intern_all(*attrList);
   for (const auto& att : *attrList) {
-    ZP att_zp = hashToZP(att, group.order);
+    const InternedAttribute& interned = interner.intern(att);
+    const ZP& att_zp = interned.zp;
     sigma.setRandom(group.order); // sigma_att
 
-    std::string attr_key = OpenABEHashKey(att);
-    this->ctx_att[attr_key] = public_key.get_h1() * sigma +
+    this->ctx_att[interned.hash_key] = public_key.get_h1() * sigma +
                          public_key.get_h2() * (sigma * att_zp) +
                          h3_times_omega;
   }
 
+  this->normalize();
+
   // ---------------------------------> Generate session key
   G1 g1;  g1.setGenerator();
   G2 g2;  g2.setGenerator();
 
   GT gt = pairing(g1, g2).exp(phi);  // Ephemeral key : gt = e(g1, g2)^phi
-  // gt_md_map(session_key, gt.m_GT);
-  size_t len;
-  uint8_t* ss_key = gt.hashToBytes(&len);
-  memcpy(session_key, ss_key, len);
+  if (!deriveSessionKey(std::span<uint8_t>(session_key, RLC_MD_LEN), gt)) {
+    std::cerr << "Error: Could not derive the session key" << std::endl;
+    return false;
+  }
   // ---------------------------------> END Generate session key
 
   return true;
@@ -174,54 +232,176 @@ void KPABE_DPVS_CIPHERTEXT::serialize(ByteString& output) const {
   result.insertFirstByte(KPABE_CIPHERTEXT_TYPE);
 
   temp.fromString(this->url);     result.smartPack(temp);
-  this->ctx_root.serialize(temp); result.smartPack(temp);
-  this->ctx_wl.serialize(temp);   result.smartPack(temp);
-  this->ctx_bl.serialize(temp);   result.smartPack(temp);
+  this->ctx_root.serialize(temp, this->compressed); result.smartPack(temp);
+  this->ctx_wl.serialize(temp, this->compressed);   result.smartPack(temp);
+  this->ctx_bl.serialize(temp, this->compressed);   result.smartPack(temp);
 
-  uint16_t ctx_att_size = this->ctx_att.size();
+  uint16_t ctx_att_size = count_v1(this->ctx_att.size());
   result.pack16bits(ctx_att_size);
   for (const auto& [att, ctx] : this->ctx_att) {
     temp.fromString(att); result.smartPack(temp);
-    ctx.serialize(temp);  result.smartPack(temp);
+    ctx.serialize(temp, this->compressed);  result.smartPack(temp);
   }
 
   result.serialize(output);
 }
 
+void KPABE_DPVS_CIPHERTEXT::serialize(ByteWriter& writer) const {
+  writer.putHeader(this->getSizeInBytes() - hdrLen);
+  writer.put8(KPABE_CIPHERTEXT_TYPE);
+
+  writer.putString(this->url);
+  writer.putVector(this->ctx_root, this->compressed);
+  writer.putVector(this->ctx_wl, this->compressed);
+  writer.putVector(this->ctx_bl, this->compressed);
+
+  writer.put16(count_v1(this->ctx_att.size()));
+  for (const auto& [att, ctx] : this->ctx_att) {
+    writer.putString(att); writer.putVector(ctx, this->compressed);
+  }
+}
+
 void KPABE_DPVS_CIPHERTEXT::deserialize(ByteString& input) {
-  ByteString temp;
-  size_t index = 0;
+  ByteReader reader({input.data(), input.size()});
+  this->deserialize(reader);
+}
+
+void KPABE_DPVS_CIPHERTEXT::deserialize(ByteReader& reader) {
   std::string att;
 
-  if (input.at(index++) != BYTESTRING || input.size() - input.get32bits(&index) < hdrLen) {
+  if (reader.remaining() > 0 && reader.peek8() == KPABE_FORMAT_V2) {
+    this->decodeV2(reader);
+    return;
+  }
+
+  if (!reader.getHeader()) {
     std::cerr << "Error: Invalid input" << std::endl;
     return;
   }
 
-  if (input.at(index++) != KPABE_CIPHERTEXT_TYPE) {
+  if (reader.get8() != KPABE_CIPHERTEXT_TYPE) {
     std::cerr << "Error: Invalid ciphertext type" << std::endl;
     return;
   }
 
-  temp = input.smartUnpack(&index); this->url = temp.toString();
+  this->url = reader.getString();
 
-  temp = input.smartUnpack(&index); this->ctx_root.deserialize(temp);
-  temp = input.smartUnpack(&index); this->ctx_wl.deserialize(temp);
-  temp = input.smartUnpack(&index); this->ctx_bl.deserialize(temp);
+  // ctx_root gives the encoding of the points, the other vectors must follow it
+  this->compressed = reader.getVector(this->ctx_root);
+  reader.getVector(this->ctx_wl, this->compressed);
+  reader.getVector(this->ctx_bl, this->compressed);
 
   std::string attributes;
-  uint16_t ctx_att_size = input.get16bits(&index);
+  this->ctx_att.clear();
+  uint16_t ctx_att_size = reader.get16();
+  this->ctx_att.reserve(ctx_att_size);
   for (uint16_t i = 0; i < ctx_att_size; i++) {
-    temp = input.smartUnpack(&index); att = temp.toString();
-    temp = input.smartUnpack(&index); this->ctx_att[att].deserialize(temp);
+    att = reader.getString();
+    reader.getVector(this->ctx_att[att], this->compressed);
     attributes += att + "|";
   }
   this->attributes = attributes;
+  this->check_points();
 
   /* The attribute order may differ from the original order during
    * serialization, but this difference does not impact functionality. */
 }
 
+bool KPABE_DPVS_CIPHERTEXT::is_valid() const {
+  G1SubgroupBatch batch;
+  batch.add(this->ctx_root);
+  batch.add(this->ctx_wl);
+  batch.add(this->ctx_bl);
+  for (const auto& [_, ctx] : this->ctx_att) batch.add(ctx);
+  return batch.verify();
+}
+
+void KPABE_DPVS_CIPHERTEXT::check_points() const {
+  if (this->validate_points && !this->is_valid()) {
+    throw std::runtime_error("Ciphertext point not in G1");
+  }
+}
+
+template <class Sink>
+void KPABE_DPVS_CIPHERTEXT::encodeV2(Sink &sink) const {
+  bool cp = this->compressed;
+  size_t ps = G1Vec<ND>::getPointSize(cp);
+
+  put_header_v2(sink, KPABE_CIPHERTEXT_TYPE, cp, {ND, NF, NG, NH});
+  {
+    ByteWriter writer = next_entry_v2(sink, this->url, (ND + NF + NG) * ps);
+    this->ctx_root.serializePoints(writer, cp);
+    this->ctx_wl.serializePoints(writer, cp);
+    this->ctx_bl.serializePoints(writer, cp);
+  }
+
+  put_count_v2(sink, this->ctx_att.size());
+  for (const auto& [att, ctx] : this->ctx_att) {
+    ByteWriter writer = next_entry_v2(sink, att, NH * ps);
+    ctx.serializePoints(writer, cp);
+  }
+}
+
+template <class Source>
+void KPABE_DPVS_CIPHERTEXT::decodeV2(Source &source) {
+  bool cp;
+  if (!get_header_v2(source, KPABE_CIPHERTEXT_TYPE, &cp, {ND, NF, NG, NH})) {
+    std::cerr << "Error: Invalid ciphertext type or dimensions" << std::endl;
+    return;
+  }
+  this->compressed = cp;
+  size_t ps = G1Vec<ND>::getPointSize(cp);
+
+  this->url = get_string_v2(source);
+  {
+    ByteReader points = source.next((ND + NF + NG) * ps);
+    this->ctx_root.deserializePoints(points, cp);
+    this->ctx_wl.deserializePoints(points, cp);
+    this->ctx_bl.deserializePoints(points, cp);
+  }
+
+  std::string attributes;
+  this->ctx_att.clear();
+  uint64_t nb_att = source.getVarint();
+  for (uint64_t i = 0; i < nb_att; i++) {
+    std::string att = get_string_v2(source);
+    ByteReader points = source.next(NH * ps);
+    this->ctx_att[att].deserializePoints(points, cp);
+    attributes += att + "|";
+  }
+  this->attributes = attributes;
+  this->check_points();
+}
+
+size_t KPABE_DPVS_CIPHERTEXT::getSizeInBytesV2() const {
+  size_t ps = G1Vec<ND>::getPointSize(this->compressed);
+
+  size_t total_size = 3 + varint_size(ND) + varint_size(NF) + varint_size(NG) + varint_size(NH)
+                    + entry_size_v2(this->url, (ND + NF + NG) * ps)
+                    + varint_size(this->ctx_att.size());
+  for (const auto& [att, _] : this->ctx_att) total_size += entry_size_v2(att, NH * ps);
+
+  return total_size;
+}
+
+void KPABE_DPVS_CIPHERTEXT::serializeV2(std::ostream &os) const {
+  StreamWriter writer(os);
+  this->encodeV2(writer);
+}
+
+void KPABE_DPVS_CIPHERTEXT::serializeV2(std::vector<uint8_t> &bytes) const {
+  bytes.resize(this->getSizeInBytesV2());
+  ByteWriter writer(bytes);
+  this->encodeV2(writer);
+  if (writer.size() != bytes.size()) {
+    throw std::logic_error("Serialized size differs from getSizeInBytesV2");
+  }
+}
+
+void KPABE_DPVS_CIPHERTEXT::deserialize(StreamReader &reader) {
+  this->decodeV2(reader);
+}
+
 #if 0
 void KPABE_DPVS_CIPHERTEXT::serialize(std::ostream &os, CompressionType compress) const {
   if (os.good()) {
@@ -275,12 +455,12 @@ void KPABE_DPVS_CIPHERTEXT::deserialize(const std::vector<uint8_t>& bytes) {
  * @param[in]  dec_key The decryption key
  * @return true if the decryption is successful, false otherwise 
  */
-bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key,
-                                    const KPABE_DPVS_DECRYPTION_KEY &dec_key,
+template <class DecKey>
+bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key, const DecKey &dec_key,
                                     ZP &randomizer) const
 {
   ZP zp, zp_bl, zp_url;
-  GT ip, ip_lsss, ip_bl, ip_root;
+  GT ip, ip_bl, ip_root;
   GT phi;
 
   std::string url = this->url;
@@ -290,6 +470,11 @@ bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key,
     return false;
   }
 
+  /*
+   * The ciphertext of a randomized public key carries the randomizer in every
+   * vector. Each pairing is linear in its G1 argument, so phi is computed as
+   * for a plain ciphertext and then raised to 1/randomizer, once.
+   */
   ZP inv_rand;
   bool isRandomizerSet = randomizer.ismember();
   if (isRandomizerSet) {
@@ -300,36 +485,51 @@ bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key,
   auto key_wl_url = dec_key.get_key_wl(url);
   if (key_wl_url) {
     // std::cout << "URL is in WHITE_LIST: " << url << std::endl;
-    if (isRandomizerSet) {
-      ip = innerProduct(this->ctx_wl * inv_rand, *key_wl_url);
-      ip_root = innerProduct(this->ctx_root * inv_rand, dec_key.get_key_root());
-    } else {
-      ip = innerProduct(this->ctx_wl, *key_wl_url);
-      ip_root = innerProduct(this->ctx_root, dec_key.get_key_root());
-    }
+    ip = innerProduct(this->ctx_wl, *key_wl_url);
+    ip_root = innerProduct(this->ctx_root, dec_key.get_key_root());
     phi = ip * ip_root;
-    // gt_md_map(session_key, phi.m_GT);
-    size_t len;
-    uint8_t* ss_key = phi.hashToBytes(&len);
-    memcpy(session_key, ss_key, len);
+    if (isRandomizerSet) phi = phi.exp(inv_rand);
 
-    return true;
+    return deriveSessionKey(std::span<uint8_t>(session_key, RLC_MD_LEN), phi);
   }
 
   // Here, the url is not in WHITE_LIST and not in BLACK_LIST
   // std::cout << "URL is not in WHITE_LIST and not in BLACK_LIST: " << url << std::endl;
 
   BPGroup group;
-  auto policy = createPolicyTree(dec_key.get_policy());
   auto attributes_list = createAttributeList(this->attributes);
+  const PolicyProgram& program = dec_key.get_policy_program();
+
+  if (attributes_list == nullptr || program.empty()) {
+    std::cerr << "Error: Could not create attribute list or compiled policy" << std::endl;
+    return false;
+  }
+
+  // The policy compiled with the key rejects an unsatisfied policy without
+  // parsing it, and gives a smallest satisfying set: the LSSS is built on it only
+  AttributeInterner& interner = AttributeInterner::global();
+  std::vector<attribute_id_t> selected;
+
+  if (!program.select(AttributeSet(*attributes_list->getAttributeList()), selected)) {
+    // std::cout << "Policy not satisfied." << std::endl;
+    return false;
+  }
 
-  if (policy == nullptr || attributes_list == nullptr) {
-    std::cerr << "Error: Could not create policy tree or attribute list" << std::endl;
+  auto policy = createPolicyTree(dec_key.get_policy());
+  if (policy == nullptr) {
+    std::cerr << "Error: Could not create policy tree" << std::endl;
     return false;
   }
 
+  std::vector<std::string> selected_names;
+  selected_names.reserve(selected.size());
+  for (attribute_id_t id : selected) {
+    selected_names.push_back(interner.get(id).name);
+  }
+  OpenABEAttributeList selected_list(selected_names.size(), selected_names);
+
   OpenABELSSS lsss;
-  if (!lsss.recoverCoefficients(policy.get(), attributes_list.get())) {
+  if (!lsss.recoverCoefficients(policy.get(), &selected_list)) {
     // std::cout << "Policy not satisfied, could not recover LSSS coefficients." << std::endl;
     return false;
   }
@@ -337,11 +537,16 @@ bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key,
 
   auto recover_coeff = lsss.getRows();
 
-  ip_lsss.setIdentity();
+  // The rows of ctx_att and the root are paired at once, the key vectors
+  // multiplied by the coefficients are kept until then
+  PairingProduct product;
+  std::vector<G2Vec<NH>> key_rows;
+  key_rows.reserve(recover_coeff.size());
+
   for (auto it = recover_coeff.begin(); it != recover_coeff.end(); it++) {
     ZP cj = it->second.element();
-    std::string attr_key = OpenABEHashKey(it->second.label());
-    std::string attr_deckey = OpenABEHashKey(it->first);
+    const std::string& attr_key = interner.intern(it->second.label()).hash_key;
+    const std::string& attr_deckey = interner.intern(it->first).hash_key;
 
     auto ctx_att__ = this->get_ctx_att(attr_key);
     auto key_att__ = dec_key.get_key_att(attr_deckey);
@@ -351,50 +556,40 @@ bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t *session_key,
       return false;
     }
 
-    if (isRandomizerSet) {
-      ip = innerProduct(*ctx_att__ * inv_rand, *key_att__ * cj);
-    } else {
-      ip = innerProduct(*ctx_att__, *key_att__ * cj);
-    }
-    ip_lsss = ip_lsss * ip;
-  }
-
-  auto __ctx_bl = this->ctx_bl;
-  if (isRandomizerSet) {
-    __ctx_bl = __ctx_bl * inv_rand;
+    key_rows.emplace_back(*key_att__ * cj);
+    product.add(*ctx_att__, key_rows.back());
   }
 
+  // Urls are hashed on each use, they are not interned (see attribute_interner.hpp)
   zp_url = hashToZP(url, group.order);
   ip_bl.setIdentity();
-  for (auto it = dec_key.get_key_bl_begin(); it != dec_key.get_key_bl_end(); it++) {
-    std::string bl = it->first;
+  dec_key.for_each_key_bl([&](const std::string& bl, const G2Vec<NG>& key_bl) {
     zp_bl = hashToZP(bl, group.order);
     zp = zp_bl - zp_url;
     zp.multInverse();
 
-    ip = innerProduct(__ctx_bl, it->second);
+    ip = innerProduct(this->ctx_bl, key_bl);
     ip_bl = ip_bl * ip.exp(zp);
-  }
+  });
 
-  if (isRandomizerSet) {
-    ip_root = innerProduct(this->ctx_root * inv_rand, dec_key.get_key_root());
-  } else {
-    ip_root = innerProduct(this->ctx_root, dec_key.get_key_root());
-  }
+  const auto& key_root = dec_key.get_key_root();
+  product.add(this->ctx_root, key_root);
 
-  phi = ip_lsss * ip_bl * ip_root;
-  // gt_md_map(session_key, phi.m_GT);
-  size_t len;
-  uint8_t* ss_key = phi.hashToBytes(&len);
-  memcpy(session_key, ss_key, len);
+  phi = product.compute() * ip_bl;
+  if (isRandomizerSet) phi = phi.exp(inv_rand);
 
-  return true;
+  return deriveSessionKey(std::span<uint8_t>(session_key, RLC_MD_LEN), phi);
 }
 
+template bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t*, const KPABE_DPVS_DECRYPTION_KEY&, ZP&) const;
+template bool KPABE_DPVS_CIPHERTEXT::decrypt(uint8_t*, const KPABE_DPVS_MAPPED_DECRYPTION_KEY&, ZP&) const;
+
 
 /**
  * @brief This method removes the scalar `k` from the ciphertext, modifying it
  *        in place. It is used when the public key is randomized with the scalar `k`.
+ *        Passing `k` as randomizer to decrypt is cheaper when the ciphertext
+ *        is only decrypted: it costs one exponentiation in GT.
  *
  * @param k the scalar to remove from the ciphertext
  */
@@ -403,13 +598,23 @@ void KPABE_DPVS_CIPHERTEXT::remove_scalar(const ZP &k)
   ZP inv_k = ZP(k);
   inv_k.multInverse();
 
-  this->ctx_root = this->ctx_root * inv_k;
-  this->ctx_wl = this->ctx_wl * inv_k;
-  this->ctx_bl = this->ctx_bl * inv_k;
+  this->ctx_root *= inv_k;
+  this->ctx_wl *= inv_k;
+  this->ctx_bl *= inv_k;
 
-  for (auto& [_, ctx] : this->ctx_att) {
-    ctx = ctx * inv_k;
+  for (auto& ctx : this->ctx_att.get_rows()) {
+    ctx *= inv_k;
   }
+
+  this->normalize();
+}
+
+void KPABE_DPVS_CIPHERTEXT::normalize()
+{
+  this->ctx_root.normalize();
+  this->ctx_wl.normalize();
+  this->ctx_bl.normalize();
+  for (auto& ctx : this->ctx_att.get_rows()) ctx.normalize();
 }
 
 size_t KPABE_DPVS_CIPHERTEXT::getSizeInBytes() const
@@ -417,10 +622,10 @@ size_t KPABE_DPVS_CIPHERTEXT::getSizeInBytes() const
   size_t total_size = hdrLen;
 
   size_t surl = this->url.size();
-  size_t sroot= this->ctx_root.getSizeInBytes();
-  size_t swl  = this->ctx_wl.getSizeInBytes();
-  size_t sbl  = this->ctx_bl.getSizeInBytes();
-  size_t satt = this->ctx_att.begin()->second.getSizeInBytes();
+  size_t sroot= this->ctx_root.getSizeInBytes(this->compressed);
+  size_t swl  = this->ctx_wl.getSizeInBytes(this->compressed);
+  size_t sbl  = this->ctx_bl.getSizeInBytes(this->compressed);
+  size_t satt = G1Vec<NH>::getSizeInBytes(this->compressed);
 
   total_size += sizeof(uint16_t) // ctx_att size
              +  sizeof(uint8_t); // element type (see serialize method)
@@ -435,3 +640,155 @@ size_t KPABE_DPVS_CIPHERTEXT::getSizeInBytes() const
 
   return total_size;
 }
+
+
+/* Identifier of an attribute in the compact format */
+static uint64_t compact_attribute_id(const std::string &attr_key)
+{
+  uint8_t digest[RLC_MD_LEN_SH256];
+  md_map_sh256(digest, reinterpret_cast<const uint8_t*>(attr_key.data()), attr_key.size());
+  return ByteReader({digest, KPABE_ATT_ID_LEN}).get64();
+}
+
+static void compact_url_digest(uint8_t *digest, const std::string &url)
+{
+  md_map_sh256(digest, reinterpret_cast<const uint8_t*>(url.data()), url.size());
+}
+
+size_t KPABE_DPVS_CIPHERTEXT::getCompactSizeInBytes() const
+{
+  size_t nb_points = ND + NF + NG + NH * this->ctx_att.size();
+
+  return hdrLen + sizeof(uint8_t)  // type
+       + sizeof(uint8_t)           // point encoding
+       + 4 * sizeof(uint8_t)       // ND, NF, NG, NH
+       + KPABE_URL_DIGEST_LEN
+       + sizeof(uint16_t) + KPABE_ATT_ID_LEN * this->ctx_att.size()
+       + G1Vec<NH>::getPointSize(this->compressed) * nb_points;
+}
+
+void KPABE_DPVS_CIPHERTEXT::serializeCompact(ByteWriter &writer) const
+{
+  // The count of attributes is 16 bits, as in format v1
+  uint16_t nb_att = count_v1(this->ctx_att.size());
+
+  writer.putHeader(this->getCompactSizeInBytes() - hdrLen);
+  writer.put8(KPABE_CIPHERTEXT_COMPACT_TYPE);
+  writer.put8(this->compressed);
+  writer.put8(ND); writer.put8(NF); writer.put8(NG); writer.put8(NH);
+
+  compact_url_digest(writer.advance(KPABE_URL_DIGEST_LEN), this->url);
+
+  writer.put16(nb_att);
+  for (const auto& [att, _] : this->ctx_att) {
+    writer.put64(compact_attribute_id(att));
+  }
+
+  this->ctx_root.serializePoints(writer, this->compressed);
+  this->ctx_wl.serializePoints(writer, this->compressed);
+  this->ctx_bl.serializePoints(writer, this->compressed);
+  for (const auto& [_, ctx] : this->ctx_att) {
+    ctx.serializePoints(writer, this->compressed);
+  }
+}
+
+void KPABE_DPVS_CIPHERTEXT::serializeCompact(std::vector<uint8_t> &bytes) const
+{
+  bytes.resize(this->getCompactSizeInBytes());
+  ByteWriter writer(bytes);
+  this->serializeCompact(writer);
+}
+
+/**
+ * @brief Read a ciphertext in the compact format. The ciphertext is parsed
+ *        aside and only replaces this one once it is complete (and valid).
+ *
+ * @param[in] bytes The compact ciphertext
+ * @param[in] url The url the ciphertext is expected for, checked against its digest
+ * @param[in] attributes The attribute names the receiver can use
+ * @return true if the ciphertext is read, false otherwise (this is unchanged)
+ */
+bool KPABE_DPVS_CIPHERTEXT::deserializeCompact(std::span<const uint8_t> bytes,
+                                               const std::string &url,
+                                               const std::vector<std::string> &attributes)
+{
+  KPABE_DPVS_CIPHERTEXT parsed;
+  parsed.hash_attributes = this->hash_attributes;
+  parsed.validate_points = this->validate_points;
+
+  try {
+    ByteReader reader(bytes);
+
+    if (!reader.getHeader() || reader.get8() != KPABE_CIPHERTEXT_COMPACT_TYPE) {
+      std::cerr << "Error: Invalid compact ciphertext" << std::endl;
+      return false;
+    }
+
+    uint8_t encoding = reader.get8();
+    if (encoding > 1 || reader.get8() != ND || reader.get8() != NF ||
+        reader.get8() != NG || reader.get8() != NH) {
+      std::cerr << "Error: Invalid compact ciphertext dimensions" << std::endl;
+      return false;
+    }
+    bool compressed = (encoding == 1);
+
+    uint8_t digest[KPABE_URL_DIGEST_LEN];
+    compact_url_digest(digest, url);
+    if (memcmp(digest, reader.advance(KPABE_URL_DIGEST_LEN), KPABE_URL_DIGEST_LEN) != 0) {
+      std::cerr << "Error: The ciphertext is not for the url " << url << std::endl;
+      return false;
+    }
+
+    // Resolve the ids with the attributes known by the receiver, parsed as in encrypt
+    std::string attributes_list;
+    for (const auto& att : attributes) attributes_list += att + "|";
+    auto parsed_list = createAttributeList(attributes_list);
+
+    std::map<uint64_t, const std::string*> known;
+    if (parsed_list != nullptr) {
+      for (const auto& att : *parsed_list->getAttributeList()) {
+        known.emplace(compact_attribute_id(OpenABEHashKey(att)), &att);
+      }
+    }
+
+    uint16_t nb_att = reader.get16();
+    std::vector<const std::string*> names(nb_att, nullptr);
+    for (uint16_t i = 0; i < nb_att; i++) {
+      auto it = known.find(reader.get64());
+      if (it != known.end()) names[i] = it->second;
+    }
+
+    parsed.compressed = compressed;
+    parsed.url = url;
+    parsed.ctx_root.deserializePoints(reader, compressed);
+    parsed.ctx_wl.deserializePoints(reader, compressed);
+    parsed.ctx_bl.deserializePoints(reader, compressed);
+
+    std::string attributes_str;
+    for (uint16_t i = 0; i < nb_att; i++) {
+      if (names[i] == nullptr) {
+        reader.advance(G1Vec<NH>::getPointSize(compressed) * NH);
+        continue;
+      }
+      parsed.ctx_att[OpenABEHashKey(*names[i])].deserializePoints(reader, compressed);
+      attributes_str += *names[i] + "|";
+    }
+    parsed.attributes = attributes_str;
+  }
+  catch (const std::out_of_range&) {
+    std::cerr << "Error: Truncated compact ciphertext" << std::endl;
+    return false;
+  }
+  catch (const std::runtime_error& e) {
+    std::cerr << "Error: Invalid compact ciphertext: " << e.what() << std::endl;
+    return false;
+  }
+
+  if (parsed.validate_points && !parsed.is_valid()) {
+    std::cerr << "Error: Compact ciphertext point not in G1" << std::endl;
+    return false;
+  }
+
+  *this = std::move(parsed);
+  return true;
+}
@@ -0,0 +1,392 @@
+/**
+ * @file mapped_key.cpp
+ * @brief Implementation of the decryption key mapped in memory
+ * @date 2024-06-11
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_key.hpp"
+
+#define HEADER_SIZE       64
+#define INDEX_ENTRY_SIZE  24
+
+/* Offsets of the fields in the header */
+#define HDR_VERSION         4
+#define HDR_POINT_SIZE      6
+#define HDR_NB_WL           8
+#define HDR_NB_BL           12
+#define HDR_NB_ATT          16
+#define HDR_POLICY_LEN      20
+#define HDR_POLICY_OFFSET   24
+#define HDR_INDEX_OFFSET    32
+#define HDR_NAMES_OFFSET    40
+#define HDR_RECORDS_OFFSET  48
+#define HDR_FILE_SIZE       56
+
+static uint64_t fnv1a_hash(const uint8_t *data, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t fnv1a_hash(const std::string &str)
+{
+  return fnv1a_hash(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+static uint64_t read_u64(const uint8_t *ptr)
+{
+  return ByteReader({ptr, 8}).get64();
+}
+
+static uint32_t read_u32(const uint8_t *ptr)
+{
+  return ByteReader({ptr, 4}).get32();
+}
+
+struct index_entry_t {
+  uint64_t hash;
+  const std::string *name;
+  const g2_t *points;
+  size_t dim;
+};
+
+/* Entries of a map, sorted by hash */
+template <class Map>
+static std::vector<index_entry_t> make_index(const Map &map)
+{
+  std::vector<index_entry_t> index;
+  index.reserve(map.size());
+  for (const auto &[name, vect] : map) {
+    index.push_back({fnv1a_hash(name), &name, vect.data(), vect.getDim()});
+  }
+  std::stable_sort(index.begin(), index.end(),
+                   [](const index_entry_t &a, const index_entry_t &b) { return a.hash < b.hash; });
+  return index;
+}
+
+
+/**
+ * @brief Write the decryption key in the mapped format. The key is written in
+ *        a temporary file which is then renamed, so a process mapping the
+ *        previous file keeps a consistent view.
+ *
+ * @param[in] dec_key The decryption key to write
+ * @param[in] filename The name of the file
+ * @return true if the file is written, false otherwise
+ */
+bool KPABE_DPVS_MAPPED_DECRYPTION_KEY::write(const KPABE_DPVS_DECRYPTION_KEY &dec_key,
+                                             const std::string &filename)
+{
+  if (!dec_key.encoded_wl.empty() || !dec_key.encoded_att.empty()) {
+    KPABE_DPVS_DECRYPTION_KEY decoded_key = dec_key;
+    decoded_key.set_lazy_decoding(false);
+    return write(decoded_key, filename);
+  }
+
+  bool compressed = dec_key.is_compressed();
+  size_t ps = G2Vec<ND>::getPointSize(compressed);
+
+  auto wl = make_index(dec_key.key_wl);
+  auto bl = make_index(dec_key.key_bl);
+  auto att = make_index(dec_key.key_att);
+
+  size_t names_size = 0, nb_points = ND;
+  for (const auto *list : {&wl, &bl, &att}) {
+    for (const auto &entry : *list) {
+      names_size += entry.name->size();
+      nb_points += entry.dim;
+    }
+  }
+
+  size_t nb_entries = wl.size() + bl.size() + att.size();
+  size_t policy_offset = HEADER_SIZE;
+  size_t index_offset = policy_offset + dec_key.policy.size();
+  size_t names_offset = index_offset + nb_entries * INDEX_ENTRY_SIZE;
+  size_t records_offset = names_offset + names_size;
+  size_t file_size = records_offset + nb_points * ps;
+
+  std::vector<uint8_t> buffer(file_size);
+  ByteWriter writer(buffer);
+
+  writer.putBytes(reinterpret_cast<const uint8_t*>(KPABE_MAPPED_KEY_MAGIC), 4);
+  writer.put16(KPABE_MAPPED_KEY_VERSION);
+  writer.put16(ps);
+  writer.put32(wl.size());
+  writer.put32(bl.size());
+  writer.put32(att.size());
+  writer.put32(dec_key.policy.size());
+  writer.put64(policy_offset);
+  writer.put64(index_offset);
+  writer.put64(names_offset);
+  writer.put64(records_offset);
+  writer.put64(file_size);
+  writer.putBytes(reinterpret_cast<const uint8_t*>(dec_key.policy.data()), dec_key.policy.size());
+
+  size_t name_offset = 0;
+  for (const auto *list : {&wl, &bl, &att}) {
+    for (const auto &entry : *list) {
+      writer.put64(entry.hash);
+      writer.put64(name_offset);
+      writer.put32(entry.name->size());
+      writer.put32(0);
+      name_offset += entry.name->size();
+    }
+  }
+
+  for (const auto *list : {&wl, &bl, &att}) {
+    for (const auto &entry : *list) {
+      writer.putBytes(reinterpret_cast<const uint8_t*>(entry.name->data()), entry.name->size());
+    }
+  }
+
+  for (size_t i = 0; i < ND; i++) {
+    g2_write_bin(writer.advance(ps), ps, dec_key.key_root.data()[i], compressed);
+  }
+  for (const auto *list : {&wl, &bl, &att}) {
+    for (const auto &entry : *list) {
+      for (size_t i = 0; i < entry.dim; i++) {
+        g2_write_bin(writer.advance(ps), ps, entry.points[i], compressed);
+      }
+    }
+  }
+
+  std::string tmp_filename = filename + ".tmp";
+  FILE *file = fopen(tmp_filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error: Could not open " << tmp_filename << std::endl;
+    return false;
+  }
+
+  bool is_written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  is_written = (fclose(file) == 0) && is_written;
+
+  if (!is_written || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    std::cerr << "Error: Could not write " << filename << std::endl;
+    remove(tmp_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+template <class Vec>
+Vec KPABE_DPVS_MAPPED_DECRYPTION_KEY::decode(const uint8_t *record) const
+{
+  Vec vect;
+  for (size_t i = 0; i < Vec::getDim(); i++) {
+    g2_read_bin(vect.data()[i], record + i * this->point_size, this->point_size);
+  }
+  return vect;
+}
+
+KPABE_DPVS_MAPPED_DECRYPTION_KEY&
+KPABE_DPVS_MAPPED_DECRYPTION_KEY::operator=(KPABE_DPVS_MAPPED_DECRYPTION_KEY &&other) noexcept
+{
+  if (this != &other) {
+    this->close();
+    this->base = std::exchange(other.base, nullptr);
+    this->length = std::exchange(other.length, 0);
+    this->policy = std::move(other.policy);
+    this->program = std::move(other.program);
+    this->point_size = other.point_size;
+    this->nb_wl = std::exchange(other.nb_wl, 0);
+    this->nb_bl = std::exchange(other.nb_bl, 0);
+    this->nb_att = std::exchange(other.nb_att, 0);
+    this->wl_index = std::exchange(other.wl_index, nullptr);
+    this->bl_index = std::exchange(other.bl_index, nullptr);
+    this->att_index = std::exchange(other.att_index, nullptr);
+    this->names = std::exchange(other.names, nullptr);
+    this->names_size = std::exchange(other.names_size, 0);
+    this->records = std::exchange(other.records, nullptr);
+    this->key_bl = std::move(other.key_bl);
+    other.key_bl.clear();
+  }
+  return *this;
+}
+
+/**
+ * @brief Map the file in memory and check its header. Nothing is decoded
+ *        here, apart from the policy (which is compiled) and the black list.
+ *
+ * @param[in] filename The name of the file
+ * @return true if the file is mapped, false otherwise
+ */
+bool KPABE_DPVS_MAPPED_DECRYPTION_KEY::open(const std::string &filename)
+{
+  this->close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Error: Could not open " << filename << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER_SIZE) {
+    std::cerr << "Error: Invalid decryption key file " << filename << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    std::cerr << "Error: Could not map " << filename << std::endl;
+    return false;
+  }
+
+  this->base = static_cast<uint8_t*>(addr);
+  this->length = st.st_size;
+
+  const uint8_t *hdr = this->base;
+  size_t ps = (hdr[HDR_POINT_SIZE] << 8) | hdr[HDR_POINT_SIZE + 1];
+  uint64_t nb_wl = read_u32(hdr + HDR_NB_WL);
+  uint64_t nb_bl = read_u32(hdr + HDR_NB_BL);
+  uint64_t nb_att = read_u32(hdr + HDR_NB_ATT);
+  uint64_t policy_len = read_u32(hdr + HDR_POLICY_LEN);
+  uint64_t policy_offset = read_u64(hdr + HDR_POLICY_OFFSET);
+  uint64_t index_offset = read_u64(hdr + HDR_INDEX_OFFSET);
+  uint64_t names_offset = read_u64(hdr + HDR_NAMES_OFFSET);
+  uint64_t records_offset = read_u64(hdr + HDR_RECORDS_OFFSET);
+  uint64_t nb_points = ND + nb_wl * NF + nb_bl * NG + nb_att * NH;
+
+  // Every section must lie in the file, in order
+  bool is_valid = memcmp(hdr, KPABE_MAPPED_KEY_MAGIC, 4) == 0
+      && ((hdr[HDR_VERSION] << 8) | hdr[HDR_VERSION + 1]) == KPABE_MAPPED_KEY_VERSION
+      && (ps == G2Vec<ND>::getPointSize(true) || ps == G2Vec<ND>::getPointSize(false))
+      && read_u64(hdr + HDR_FILE_SIZE) == this->length
+      && policy_offset == HEADER_SIZE
+      && index_offset == policy_offset + policy_len
+      && names_offset == index_offset + (nb_wl + nb_bl + nb_att) * INDEX_ENTRY_SIZE
+      && names_offset <= records_offset
+      && records_offset <= this->length
+      && nb_points * ps == this->length - records_offset;
+
+  if (!is_valid) {
+    std::cerr << "Error: Invalid decryption key file " << filename << std::endl;
+    this->close();
+    return false;
+  }
+
+  this->policy.assign(reinterpret_cast<const char*>(this->base + policy_offset), policy_len);
+  if (!this->program.compile(this->policy)) {
+    std::cerr << "Error: Invalid policy in " << filename << std::endl;
+    this->close();
+    return false;
+  }
+  this->point_size = ps;
+  this->nb_wl = nb_wl;
+  this->nb_bl = nb_bl;
+  this->nb_att = nb_att;
+  this->wl_index = this->base + index_offset;
+  this->bl_index = this->wl_index + nb_wl * INDEX_ENTRY_SIZE;
+  this->att_index = this->bl_index + nb_bl * INDEX_ENTRY_SIZE;
+  this->names = this->base + names_offset;
+  this->names_size = records_offset - names_offset;
+  this->records = this->base + records_offset;
+
+  try {
+    const uint8_t *record = this->get_record(ND + nb_wl * NF);
+    this->key_bl.reserve(nb_bl);
+    for (size_t i = 0; i < nb_bl; i++, record += NG * ps) {
+      this->key_bl.emplace_back(this->get_name(this->bl_index + i * INDEX_ENTRY_SIZE),
+                                this->decode<G2Vec<NG>>(record));
+    }
+  }
+  catch (const std::exception& e) {
+    std::cerr << "Error: Invalid black list in " << filename << ": " << e.what() << std::endl;
+    this->close();
+    return false;
+  }
+
+  return true;
+}
+
+void KPABE_DPVS_MAPPED_DECRYPTION_KEY::close()
+{
+  if (this->base != nullptr) {
+    munmap(this->base, this->length);
+  }
+  this->base = nullptr;
+  this->length = 0;
+  this->policy.clear();
+  this->program = PolicyProgram();
+  this->nb_wl = this->nb_bl = this->nb_att = 0;
+  this->wl_index = this->bl_index = this->att_index = nullptr;
+  this->names = this->records = nullptr;
+  this->names_size = 0;
+  this->key_bl.clear();
+}
+
+std::string KPABE_DPVS_MAPPED_DECRYPTION_KEY::get_name(const uint8_t *entry) const
+{
+  uint64_t offset = read_u64(entry + 8);
+  uint32_t len = read_u32(entry + 16);
+  if (offset > this->names_size || len > this->names_size - offset) {
+    throw std::out_of_range("Invalid name in decryption key file");
+  }
+  return std::string(reinterpret_cast<const char*>(this->names + offset), len);
+}
+
+/* Return the position of name in the sorted index, if any */
+std::optional<size_t>
+KPABE_DPVS_MAPPED_DECRYPTION_KEY::find(const uint8_t *index, size_t size,
+                                       const std::string &name) const
+{
+  uint64_t hash = fnv1a_hash(name);
+
+  size_t low = 0, high = size;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (read_u64(index + mid * INDEX_ENTRY_SIZE) < hash) low = mid + 1;
+    else high = mid;
+  }
+
+  for (size_t i = low; i < size && read_u64(index + i * INDEX_ENTRY_SIZE) == hash; i++) {
+    if (this->get_name(index + i * INDEX_ENTRY_SIZE) == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+const uint8_t* KPABE_DPVS_MAPPED_DECRYPTION_KEY::get_record(size_t nb_points) const
+{
+  return this->records + nb_points * this->point_size;
+}
+
+G2Vec<ND> KPABE_DPVS_MAPPED_DECRYPTION_KEY::get_key_root() const
+{
+  return this->decode<G2Vec<ND>>(this->get_record(0));
+}
+
+std::optional<G2Vec<NF>> KPABE_DPVS_MAPPED_DECRYPTION_KEY::get_key_wl(const std::string &url) const
+{
+  auto i = this->find(this->wl_index, this->nb_wl, url);
+  if (!i) return std::nullopt;
+  return this->decode<G2Vec<NF>>(this->get_record(ND + *i * NF));
+}
+
+std::optional<G2Vec<NH>> KPABE_DPVS_MAPPED_DECRYPTION_KEY::get_key_att(const std::string &att) const
+{
+  auto i = this->find(this->att_index, this->nb_att, att);
+  if (!i) return std::nullopt;
+  return this->decode<G2Vec<NH>>(
+      this->get_record(ND + this->nb_wl * NF + this->nb_bl * NG + *i * NH));
+}
@@ -0,0 +1,329 @@
+/**
+ * @file md_batch.cpp
+ * @brief Implementation of the multi-buffer SHA-256
+ * @date 2024-07-04
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+
+#include "md_batch.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    defined(MD_MAP) && defined(SH256) && MD_MAP == SH256
+#define MD_BATCH_SIMD   true
+#include <immintrin.h>
+#else
+#define MD_BATCH_SIMD   false
+#endif
+
+
+#if MD_BATCH_SIMD
+
+#define SHA256_BLOCK_LEN    64
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_h0[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void write_be32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+/*
+ * A kernel hashes up to `lanes` padded messages. The message of lane l is at
+ * padded + l * max_blocks * 64 and has nblocks[l] blocks, its state is left
+ * unchanged by the blocks after its last one.
+ */
+typedef void (*sha256_lanes_t)(uint8_t *digests, const uint8_t *padded,
+                               const size_t *nblocks, size_t max_blocks);
+
+
+/* ------------------------------- AVX2, 8 lanes ------------------------------- */
+
+#define AVX2    __attribute__((target("avx2")))
+
+AVX2 static inline __m256i ror8(__m256i x, int n)
+{
+  return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+AVX2 static void sha256_x8(uint8_t *digests, const uint8_t *padded,
+                           const size_t *nblocks, size_t max_blocks)
+{
+  alignas(32) uint32_t words[16][8];
+  alignas(32) uint32_t mask[8];
+  __m256i s[8], w[16], v[8];
+
+  for (int i = 0; i < 8; i++) s[i] = _mm256_set1_epi32(sha256_h0[i]);
+
+  for (size_t b = 0; b < max_blocks; b++) {
+    for (int l = 0; l < 8; l++) {
+      const uint8_t *block = padded + (l * max_blocks + b) * SHA256_BLOCK_LEN;
+      for (int t = 0; t < 16; t++) words[t][l] = read_be32(block + 4 * t);
+      mask[l] = (b < nblocks[l]) ? 0xFFFFFFFF : 0;
+    }
+    for (int t = 0; t < 16; t++) w[t] = _mm256_load_si256((const __m256i*)words[t]);
+    for (int i = 0; i < 8; i++) v[i] = s[i];
+
+    for (int t = 0; t < 64; t++) {
+      if (t >= 16) {
+        __m256i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ror8(w15, 7), ror8(w15, 18)), _mm256_srli_epi32(w15, 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ror8(w2, 17), ror8(w2, 19)), _mm256_srli_epi32(w2, 10));
+        w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0),
+                                     _mm256_add_epi32(w[(t - 7) & 15], s1));
+      }
+
+      __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(ror8(v[4], 6), ror8(v[4], 11)), ror8(v[4], 25));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(v[4], v[5]), _mm256_andnot_si256(v[4], v[6]));
+      __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(v[7], S1),
+                                    _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(sha256_k[t]), w[t & 15])));
+      __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(ror8(v[0], 2), ror8(v[0], 13)), ror8(v[0], 22));
+      __m256i maj = _mm256_or_si256(_mm256_and_si256(v[0], v[1]), _mm256_and_si256(v[2], _mm256_or_si256(v[0], v[1])));
+      __m256i t2 = _mm256_add_epi32(S0, maj);
+
+      v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+      v[4] = _mm256_add_epi32(v[3], t1);
+      v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+      v[0] = _mm256_add_epi32(t1, t2);
+    }
+
+    __m256i m = _mm256_load_si256((const __m256i*)mask);
+    for (int i = 0; i < 8; i++) {
+      s[i] = _mm256_blendv_epi8(s[i], _mm256_add_epi32(s[i], v[i]), m);
+    }
+  }
+
+  for (int i = 0; i < 8; i++) {
+    _mm256_store_si256((__m256i*)words[i], s[i]);
+  }
+  for (int l = 0; l < 8; l++) {
+    for (int i = 0; i < 8; i++) write_be32(digests + l * RLC_MD_LEN + 4 * i, words[i][l]);
+  }
+}
+
+
+/* ----------------------------- AVX-512, 16 lanes ----------------------------- */
+
+#define AVX512  __attribute__((target("avx512f")))
+
+// GCC 12 warns about _mm512_undefined_epi32 in its own intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+AVX512 static void sha256_x16(uint8_t *digests, const uint8_t *padded,
+                              const size_t *nblocks, size_t max_blocks)
+{
+  alignas(64) uint32_t words[16][16];
+  __m512i s[8], w[16], v[8];
+
+  for (int i = 0; i < 8; i++) s[i] = _mm512_set1_epi32(sha256_h0[i]);
+
+  for (size_t b = 0; b < max_blocks; b++) {
+    __mmask16 mask = 0;
+    for (int l = 0; l < 16; l++) {
+      const uint8_t *block = padded + (l * max_blocks + b) * SHA256_BLOCK_LEN;
+      for (int t = 0; t < 16; t++) words[t][l] = read_be32(block + 4 * t);
+      if (b < nblocks[l]) mask |= (__mmask16)(1 << l);
+    }
+    for (int t = 0; t < 16; t++) w[t] = _mm512_load_si512(words[t]);
+    for (int i = 0; i < 8; i++) v[i] = s[i];
+
+    for (int t = 0; t < 64; t++) {
+      if (t >= 16) {
+        __m512i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+        __m512i s0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18)), _mm512_srli_epi32(w15, 3));
+        __m512i s1 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19)), _mm512_srli_epi32(w2, 10));
+        w[t & 15] = _mm512_add_epi32(_mm512_add_epi32(w[t & 15], s0),
+                                     _mm512_add_epi32(w[(t - 7) & 15], s1));
+      }
+
+      // ch = (e & f) ^ (~e & g) and maj = majority(a, b, c), as ternary logic
+      __m512i S1 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(v[4], 6), _mm512_ror_epi32(v[4], 11)), _mm512_ror_epi32(v[4], 25));
+      __m512i ch = _mm512_ternarylogic_epi32(v[4], v[5], v[6], 0xCA);
+      __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(v[7], S1),
+                                    _mm512_add_epi32(ch, _mm512_add_epi32(_mm512_set1_epi32(sha256_k[t]), w[t & 15])));
+      __m512i S0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(v[0], 2), _mm512_ror_epi32(v[0], 13)), _mm512_ror_epi32(v[0], 22));
+      __m512i maj = _mm512_ternarylogic_epi32(v[0], v[1], v[2], 0xE8);
+      __m512i t2 = _mm512_add_epi32(S0, maj);
+
+      v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+      v[4] = _mm512_add_epi32(v[3], t1);
+      v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+      v[0] = _mm512_add_epi32(t1, t2);
+    }
+
+    for (int i = 0; i < 8; i++) {
+      s[i] = _mm512_mask_add_epi32(s[i], mask, s[i], v[i]);
+    }
+  }
+
+  for (int i = 0; i < 8; i++) {
+    _mm512_store_si512(words[i], s[i]);
+  }
+  for (int l = 0; l < 16; l++) {
+    for (int i = 0; i < 8; i++) write_be32(digests + l * RLC_MD_LEN + 4 * i, words[i][l]);
+  }
+}
+
+#pragma GCC diagnostic pop
+
+
+/* --------------------------------- Dispatch --------------------------------- */
+
+static size_t padded_blocks(size_t len)
+{
+  // Message, 0x80 and the 64-bit length
+  return (len + 1 + 8 + SHA256_BLOCK_LEN - 1) / SHA256_BLOCK_LEN;
+}
+
+/**
+ * @brief Hash the inputs `lanes` at a time with the kernel. Inputs are sorted
+ *        by number of blocks and padded in one buffer per group.
+ */
+static void md_map_lanes(std::vector<md_digest_t> &digests,
+                         const std::vector<std::string> &inputs,
+                         size_t lanes, sha256_lanes_t kernel)
+{
+  const size_t n = inputs.size();
+  std::vector<size_t> order(n), blocks(n);
+  std::vector<uint8_t> padded;
+  size_t nblocks[16];
+  uint8_t group_digests[16 * RLC_MD_LEN];
+
+  for (size_t i = 0; i < n; i++) blocks[i] = padded_blocks(inputs[i].size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return blocks[a] < blocks[b]; });
+
+  for (size_t start = 0; start < n; start += lanes) {
+    size_t count = std::min(lanes, n - start);
+    size_t max_blocks = blocks[order[start + count - 1]];
+
+    padded.assign(lanes * max_blocks * SHA256_BLOCK_LEN, 0);
+    for (size_t l = 0; l < lanes; l++) {
+      nblocks[l] = 0;
+      if (l >= count) continue;
+
+      const std::string &input = inputs[order[start + l]];
+      uint8_t *message = padded.data() + l * max_blocks * SHA256_BLOCK_LEN;
+      uint64_t bits = (uint64_t)input.size() * 8;
+
+      nblocks[l] = blocks[order[start + l]];
+      memcpy(message, input.data(), input.size());
+      message[input.size()] = 0x80;
+      uint8_t *length = message + nblocks[l] * SHA256_BLOCK_LEN - 8;
+      write_be32(length, (uint32_t)(bits >> 32));
+      write_be32(length + 4, (uint32_t)bits);
+    }
+
+    kernel(group_digests, padded.data(), nblocks, max_blocks);
+
+    for (size_t l = 0; l < count; l++) {
+      memcpy(digests[order[start + l]].data(), group_digests + l * RLC_MD_LEN, RLC_MD_LEN);
+    }
+  }
+}
+
+typedef enum MdBatchKernel {
+  MD_BATCH_SCALAR,
+  MD_BATCH_AVX2,
+  MD_BATCH_AVX512,
+} MdBatchKernel;
+
+static MdBatchKernel md_batch_detect()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return MD_BATCH_AVX512;
+  if (__builtin_cpu_supports("avx2")) return MD_BATCH_AVX2;
+  return MD_BATCH_SCALAR;
+}
+
+// Detected on first use, md_batch_set_method may replace it
+static std::atomic<MdBatchKernel>& md_batch_kernel_ref()
+{
+  static std::atomic<MdBatchKernel> kernel{md_batch_detect()};
+  return kernel;
+}
+
+static MdBatchKernel md_batch_kernel()
+{
+  return md_batch_kernel_ref().load(std::memory_order_relaxed);
+}
+
+#endif // MD_BATCH_SIMD
+
+
+void md_map_batch(std::vector<md_digest_t> &digests,
+                  const std::vector<std::string> &inputs)
+{
+  digests.resize(inputs.size());
+
+#if MD_BATCH_SIMD
+  if (inputs.size() >= KPABE_MD_BATCH_MIN) {
+    switch (md_batch_kernel()) {
+      case MD_BATCH_AVX512:
+        md_map_lanes(digests, inputs, 16, sha256_x16);
+        return;
+      case MD_BATCH_AVX2:
+        md_map_lanes(digests, inputs, 8, sha256_x8);
+        return;
+      default:
+        break;
+    }
+  }
+#endif
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    md_map(digests[i].data(), (const uint8_t*)inputs[i].data(), inputs[i].size());
+  }
+}
+
+const char* md_batch_method()
+{
+#if MD_BATCH_SIMD
+  switch (md_batch_kernel()) {
+    case MD_BATCH_AVX512: return "avx512";
+    case MD_BATCH_AVX2:   return "avx2";
+    default:              break;
+  }
+#endif
+  return "scalar";
+}
+
+bool md_batch_set_method(const std::string &method)
+{
+#if MD_BATCH_SIMD
+  std::atomic<MdBatchKernel>& kernel = md_batch_kernel_ref();
+
+  if (method == "auto") kernel = md_batch_detect();
+  else if (method == "scalar") kernel = MD_BATCH_SCALAR;
+  else if (method == "avx2" && __builtin_cpu_supports("avx2")) kernel = MD_BATCH_AVX2;
+  else if (method == "avx512" && __builtin_cpu_supports("avx512f")) kernel = MD_BATCH_AVX512;
+  else return false;
+  return true;
+#else
+  return method == "auto" || method == "scalar";
+#endif
+}
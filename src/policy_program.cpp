@@ -0,0 +1,195 @@
+/**
+ * @file policy_program.cpp
+ * @brief Implementation of the compiled policies
+ * @date 2024-07-01
+ *
+ */
+
+#include <algorithm>
+#include <limits>
+
+#include "policy_program.hpp"
+
+
+AttributeSet::AttributeSet(const std::string &attributes)
+{
+  auto attributes_list = createAttributeList(attributes);
+  if (attributes_list != nullptr) {
+    *this = AttributeSet(*attributes_list->getAttributeList());
+  }
+}
+
+AttributeSet::AttributeSet(const std::vector<std::string> &attributes)
+{
+  const AttributeInterner& interner = AttributeInterner::global();
+  for (const auto& att : attributes) {
+    const InternedAttribute* interned = interner.find(att);
+    if (interned != nullptr) this->insert(interned->id);
+  }
+}
+
+bool PolicyProgram::compile(const std::string &policy)
+{
+  auto policy_tree = createPolicyTree(policy);
+  if (policy_tree == nullptr) {
+    this->nodes.clear();
+    this->children.clear();
+    return false;
+  }
+  return this->compile(*policy_tree);
+}
+
+bool PolicyProgram::compile(OpenABEPolicy &policy)
+{
+  this->nodes.clear();
+  this->children.clear();
+
+  if (!this->compile_node(policy.getRootNode(), AttributeInterner::global())) {
+    this->nodes.clear();
+    this->children.clear();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Append the node and its subtree to the program, the node last.
+ *
+ * @param[in] node The node to compile
+ * @param[in] interner The dictionary of the leaf ids
+ * @return false if the tree has an unknown node type or a gate without child
+ */
+bool PolicyProgram::compile_node(OpenABETreeNode *node, AttributeInterner &interner)
+{
+  if (node == nullptr) return false;
+
+  Node compiled = {0, 0, 0, 0};
+  uint32_t nb_subnodes = node->getNumSubnodes();
+
+  switch (node->getNodeType()) {
+    case TREE_NODE_TYPE_LEAF:
+      compiled.id = interner.intern(node->getCompleteLabel()).id;
+      this->nodes.push_back(compiled);
+      return true;
+    case TREE_NODE_TYPE_AND:
+      compiled.threshold = nb_subnodes;
+      break;
+    case TREE_NODE_TYPE_OR:
+      compiled.threshold = 1;
+      break;
+    case TREE_NODE_TYPE_THRESH:
+      compiled.threshold = node->getThresholdValue();
+      break;
+    default:
+      return false;
+  }
+
+  if (nb_subnodes == 0 || compiled.threshold == 0 || compiled.threshold > nb_subnodes) {
+    return false;
+  }
+
+  // The children of a gate are contiguous, they are added once the subtrees
+  // (and the children of their own gates) are compiled
+  std::vector<uint32_t> subnodes;
+  subnodes.reserve(nb_subnodes);
+  for (uint32_t i = 0; i < nb_subnodes; i++) {
+    if (!this->compile_node(node->getSubnode(i), interner)) return false;
+    subnodes.push_back(this->nodes.size() - 1);
+  }
+
+  compiled.first = this->children.size();
+  compiled.count = nb_subnodes;
+  this->children.insert(this->children.end(), subnodes.begin(), subnodes.end());
+  this->nodes.push_back(compiled);
+
+  return true;
+}
+
+bool PolicyProgram::is_satisfied(const AttributeSet &attributes) const
+{
+  if (this->nodes.empty()) return false;
+
+  std::vector<uint8_t> value(this->nodes.size());
+
+  for (size_t i = 0; i < this->nodes.size(); i++) {
+    const Node& node = this->nodes[i];
+    if (node.count == 0) {
+      value[i] = attributes.contains(node.id);
+      continue;
+    }
+
+    uint32_t nb_satisfied = 0;
+    for (uint32_t j = node.first; j < node.first + node.count; j++) {
+      nb_satisfied += value[this->children[j]];
+    }
+    value[i] = (nb_satisfied >= node.threshold);
+  }
+
+  return value.back();
+}
+
+/**
+ * @brief Find a satisfying set of leaves of minimal size. The cost of a node
+ *        is the number of leaves needed to satisfy it: 1 for a leaf in the
+ *        set, the sum of the `threshold` cheapest children for a gate. The
+ *        cheapest children are then followed from the root.
+ *
+ * @param[in]  attributes The attributes of the ciphertext
+ * @param[out] selected The ids of the selected leaves, sorted and unique
+ * @return true if the policy is satisfied, false otherwise
+ */
+bool PolicyProgram::select(const AttributeSet &attributes,
+                           std::vector<attribute_id_t> &selected) const
+{
+  const uint32_t unsatisfied = std::numeric_limits<uint32_t>::max();
+
+  selected.clear();
+  if (this->nodes.empty()) return false;
+
+  std::vector<uint32_t> cost(this->nodes.size());
+  std::vector<uint32_t> costs;
+
+  // Children of a gate sorted by cost, the first `threshold` are the cheapest
+  auto cheapest = [&](const Node& node, std::vector<uint32_t>& order) {
+    order.assign(this->children.begin() + node.first,
+                 this->children.begin() + node.first + node.count);
+    std::partial_sort(order.begin(), order.begin() + node.threshold, order.end(),
+                      [&](uint32_t a, uint32_t b) { return cost[a] < cost[b]; });
+  };
+
+  for (size_t i = 0; i < this->nodes.size(); i++) {
+    const Node& node = this->nodes[i];
+    if (node.count == 0) {
+      cost[i] = attributes.contains(node.id) ? 1 : unsatisfied;
+      continue;
+    }
+
+    cheapest(node, costs);
+    uint64_t sum = 0;
+    for (uint32_t j = 0; j < node.threshold && sum < unsatisfied; j++) {
+      sum += cost[costs[j]];
+    }
+    cost[i] = (uint32_t)std::min<uint64_t>(sum, unsatisfied);
+  }
+
+  if (cost.back() == unsatisfied) return false;
+
+  std::vector<uint32_t> stack = {(uint32_t)(this->nodes.size() - 1)};
+  while (!stack.empty()) {
+    const Node& node = this->nodes[stack.back()];
+    stack.pop_back();
+
+    if (node.count == 0) {
+      selected.push_back(node.id);
+      continue;
+    }
+
+    cheapest(node, costs);
+    stack.insert(stack.end(), costs.begin(), costs.begin() + node.threshold);
+  }
+
+  std::sort(selected.begin(), selected.end());
+  selected.erase(std::unique(selected.begin(), selected.end()), selected.end());
+
+  return true;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file subgroup_check.cpp
+ * @brief Implementation of the subgroup checks
+ * @date 2024-06-20
+ *
+ */
+
+#include <atomic>
+
+#include "subgroup_check.hpp"
+#include "thread_pool.hpp"
+
+
+static bool g1_in_subgroup(const g1_t p)
+{
+  return g1_is_infty(p) || g1_is_valid(p);
+}
+
+static bool g2_in_subgroup(const g2_t p)
+{
+  return g2_is_infty(p) || g2_is_valid(p);
+}
+
+bool G1SubgroupBatch::verify() const
+{
+  std::atomic<bool> is_valid{true};
+  ThreadPool::global().parallel_for(this->points.size(), [&](size_t i) {
+    if (is_valid && !g1_in_subgroup(*this->points[i])) is_valid = false;
+  });
+  return is_valid;
+}
+
+bool G2SubgroupBatch::verify() const
+{
+  std::atomic<bool> is_valid{true};
+  ThreadPool::global().parallel_for(this->points.size(), [&](size_t i) {
+    if (is_valid && !g2_in_subgroup(*this->points[i])) is_valid = false;
+  });
+  return is_valid;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Implementation of the pool of worker threads
+ * @date 2024-05-21
+ *
+ */
+
+#include <iostream>
+
+extern "C" {
+  #include <relic/relic.h>
+}
+
+#include "thread_pool.hpp"
+
+#if defined(MULTI) && defined(PTHREAD) && MULTI == PTHREAD
+#define RELIC_THREAD_SAFE   true
+#else
+#define RELIC_THREAD_SAFE   false
+#endif
+
+// Set in the threads of a pool, nested parallel_for calls run inline
+static thread_local bool in_pool_worker = false;
+
+ThreadPool::ThreadPool(size_t nb_workers)
+{
+  if (!RELIC_THREAD_SAFE || nb_workers == 0) return;
+
+  int param = ep_param_get();
+  for (size_t i = 0; i < nb_workers; i++) {
+    this->workers.emplace_back(&ThreadPool::worker_loop, this, param);
+  }
+
+  // Wait for the RELIC context of every worker, drop the pool on failure
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->cv_done.wait(lock, [this] { return this->ready == this->workers.size(); });
+
+  if (this->failed != 0) {
+    std::cerr << "Warning: RELIC could not be initialized in worker threads" << std::endl;
+    this->stop = true;
+    lock.unlock();
+    this->cv_job.notify_all();
+    for (auto& worker : this->workers) worker.join();
+    this->workers.clear();
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->cv_job.notify_all();
+  for (auto& worker : this->workers) worker.join();
+}
+
+ThreadPool& ThreadPool::global()
+{
+  static ThreadPool pool(std::thread::hardware_concurrency() > 1 ?
+                         std::thread::hardware_concurrency() - 1 : 0);
+  return pool;
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& job)
+{
+  if (n == 0) return;
+
+  if (this->workers.empty() || n == 1 || in_pool_worker) {
+    for (size_t i = 0; i < n; i++) job(i);
+    return;
+  }
+
+  std::lock_guard<std::mutex> batch(this->batch_mutex);
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->job = &job;
+    this->job_size = n;
+    this->next_job = 0;
+    this->active = this->workers.size();
+    this->error = nullptr;
+    this->generation++;
+  }
+  this->cv_job.notify_all();
+
+  in_pool_worker = true;
+  this->run_jobs();
+  in_pool_worker = false;
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->cv_done.wait(lock, [this] { return this->active == 0; });
+  this->job = nullptr;
+
+  if (this->error) std::rethrow_exception(this->error);
+}
+
+void ThreadPool::run_jobs()
+{
+  size_t i;
+  while ((i = this->next_job.fetch_add(1)) < this->job_size) {
+    try {
+      (*this->job)(i);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->error) this->error = std::current_exception();
+    }
+  }
+}
+
+void ThreadPool::worker_loop(int param)
+{
+  in_pool_worker = true;
+
+  bool is_init = (core_init() == RLC_OK);
+  if (is_init) {
+    pc_param_set_any();
+    is_init = (ep_param_get() == param);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->ready++;
+    if (!is_init) this->failed++;
+  }
+  this->cv_done.notify_all();
+
+  uint64_t generation = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cv_job.wait(lock, [&] { return this->stop || this->generation != generation; });
+    if (this->stop) break;
+
+    generation = this->generation;
+    lock.unlock();
+
+    this->run_jobs();
+
+    lock.lock();
+    if (--this->active == 0) this->cv_done.notify_all();
+  }
+
+  core_clean();
+}
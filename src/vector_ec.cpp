@@ -1,4 +1,9 @@
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
 #include "vector_ec.hpp"
+#include "md_batch.hpp"
 
 
 /****************************************************************************/
@@ -57,11 +62,8 @@ g1_vector_ptr G1_VECTOR::getG1Vector() const {
   size_t dim = this->getDim();
   g1_vector_ptr g1_vector = nullptr;
   if (dim > 0) {
-    g1_vector = (g1_vector_ptr)malloc(sizeof(g1_vector_t));
-    g1_vector->elements = (g1_t *)malloc(sizeof(g1_t) * dim);
-    g1_vector->dim = dim;
-
-    for (size_t i = 0; i < dim; i++) {
+    g1_vector = dpvs_create_g1_vect(dim);
+    for (size_t i = 0; g1_vector != nullptr && i < dim; i++) {
       g1_copy(g1_vector->elements[i], this->at(i).m_G1);
     }
   }
@@ -123,6 +125,15 @@ G1_VECTOR & G1_VECTOR::operator=(const G1_VECTOR &other) {
   return *this;
 }
 
+G1_VECTOR & G1_VECTOR::operator=(G1_VECTOR &&other) noexcept {
+  if (this != &other) {
+    static_cast<std::vector<G1>&>(*this) = std::move(static_cast<std::vector<G1>&>(other));
+    isDimSet = other.isDimSet;
+    dim = other.dim;
+  }
+  return *this;
+}
+
 G1_VECTOR G1_VECTOR::operator+(const G1_VECTOR &other) const {
   if (this->getDim() != other.getDim()) {
     std::cerr << "[ERROR] G1 vector size mismatch: " << this->getDim() << " vs " << other.getDim() << std::endl;
@@ -144,6 +155,24 @@ G1_VECTOR G1_VECTOR::operator*(const ZP &k) const {
   return result;
 }
 
+G1_VECTOR & G1_VECTOR::operator+=(const G1_VECTOR &other) {
+  if (this->getDim() != other.getDim()) {
+    throw std::runtime_error("Cannot add two vectors with different dimensions");
+  }
+
+  for (size_t i = 0; i < this->getDim(); i++) {
+    g1_add(this->at(i).m_G1, this->at(i).m_G1, other.at(i).m_G1);
+  }
+  return *this;
+}
+
+G1_VECTOR & G1_VECTOR::operator*=(const ZP &k) {
+  for (size_t i = 0; i < this->getDim(); i++) {
+    g1_mul(this->at(i).m_G1, this->at(i).m_G1, k.m_ZP);
+  }
+  return *this;
+}
+
 
 /****************************************************************************/
 /*                                G2_VECTOR                                 */
@@ -204,11 +233,8 @@ g2_vector_ptr G2_VECTOR::getG2Vector() const {
   size_t dim = this->getDim();
   g2_vector_ptr g2_vector = nullptr;
   if (dim > 0) {
-    g2_vector = (g2_vector_ptr)malloc(sizeof(g2_vector_t));
-    g2_vector->elements = (g2_t *)malloc(sizeof(g2_t) * dim);
-    g2_vector->dim = dim;
-
-    for (size_t i = 0; i < dim; i++) {
+    g2_vector = dpvs_create_g2_vect(dim);
+    for (size_t i = 0; g2_vector != nullptr && i < dim; i++) {
       g2_copy(g2_vector->elements[i], this->at(i).m_G2);
     }
   }
@@ -270,6 +296,15 @@ G2_VECTOR & G2_VECTOR::operator=(const G2_VECTOR &other) {
   return *this;
 }
 
+G2_VECTOR & G2_VECTOR::operator=(G2_VECTOR &&other) noexcept {
+  if (this != &other) {
+    static_cast<std::vector<G2>&>(*this) = std::move(static_cast<std::vector<G2>&>(other));
+    isDimSet = other.isDimSet;
+    dim = other.dim;
+  }
+  return *this;
+}
+
 G2_VECTOR G2_VECTOR::operator+(const G2_VECTOR &other) const {
   if (this->getDim() != other.getDim()) {
     std::cerr << "[ERROR] G2 vector size mismatch: " << this->getDim() << " vs " << other.getDim() << std::endl;
@@ -291,6 +326,24 @@ G2_VECTOR G2_VECTOR::operator*(const ZP &k) const {
   return result;
 }
 
+G2_VECTOR & G2_VECTOR::operator+=(const G2_VECTOR &other) {
+  if (this->getDim() != other.getDim()) {
+    throw std::runtime_error("Cannot add two vectors with different dimensions");
+  }
+
+  for (size_t i = 0; i < this->getDim(); i++) {
+    g2_add(this->at(i).m_G2, this->at(i).m_G2, other.at(i).m_G2);
+  }
+  return *this;
+}
+
+G2_VECTOR & G2_VECTOR::operator*=(const ZP &k) {
+  for (size_t i = 0; i < this->getDim(); i++) {
+    g2_mul(this->at(i).m_G2, this->at(i).m_G2, k.m_ZP);
+  }
+  return *this;
+}
+
 
 GT innerProduct(const G1_VECTOR &x, const G2_VECTOR &y) {
   if (x.getDim() != y.getDim()) {
@@ -313,25 +366,13 @@ GT innerProduct(const G1_VECTOR &x, const G2_VECTOR &y) {
 }
 
 void clear_g1_vector(g1_vector_ptr &g1_vector) {
-  if (g1_vector != nullptr) {
-    for (size_t i = 0; i < g1_vector->dim; i++) {
-      g1_free(g1_vector->elements[i]);
-    }
-    free(g1_vector->elements);
-    free(g1_vector);
-    g1_vector = nullptr;
-  }
+  dpvs_clear_g1_vect(g1_vector);
+  g1_vector = nullptr;
 }
 
 void clear_g2_vector(g2_vector_ptr &g2_vector) {
-  if (g2_vector != nullptr) {
-    for (size_t i = 0; i < g2_vector->dim; i++) {
-      g2_free(g2_vector->elements[i]);
-    }
-    free(g2_vector->elements);
-    free(g2_vector);
-    g2_vector = nullptr;
-  }
+  dpvs_clear_g2_vect(g2_vector);
+  g2_vector = nullptr;
 }
 
 ZP hashToZP(const std::string &str) {
@@ -351,3 +392,40 @@ ZP hashToZP(const std::string &str, const bn_t order) {
   result.setOrder(order);
   return result;
 }
+
+std::vector<ZP> hashToZP(const std::vector<std::string> &strs, const bn_t order) {
+  std::vector<md_digest_t> hashes;
+  md_map_batch(hashes, strs);
+
+  std::vector<ZP> result(strs.size());
+  for (size_t i = 0; i < strs.size(); i++) {
+    bn_read_bin(result[i].m_ZP, hashes[i].data(), RLC_MD_LEN);
+    bn_mod(result[i].m_ZP, result[i].m_ZP, order);
+    result[i].setOrder(order);
+  }
+  return result;
+}
+
+session_key_t deriveSessionKey(const GT &gt) {
+  session_key_t session_key;
+  if (!deriveSessionKey(session_key, gt)) {
+    throw std::runtime_error("Could not derive the session key");
+  }
+  return session_key;
+}
+
+bool deriveSessionKey(std::span<uint8_t> session_key, const GT &gt) {
+  if (session_key.size() < RLC_MD_LEN) {
+    return false;
+  }
+
+  // hashToBytes returns a new[] buffer that the caller owns
+  size_t len = 0;
+  std::unique_ptr<uint8_t[]> digest(gt.hashToBytes(&len));
+  if (digest == nullptr || len < RLC_MD_LEN) {
+    return false;
+  }
+
+  memcpy(session_key.data(), digest.get(), RLC_MD_LEN);
+  return true;
+}
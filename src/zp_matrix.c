@@ -0,0 +1,458 @@
+#include "zp_matrix.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef unsigned __int128 zp_dbl_t;
+
+/* Size of the accumulator used by the lazy reduction */
+#define ZP_ACC_DIGS   (2 * ZP_DIGS + 2)
+
+/************************ STATIC FUNCTION PROTOTYPES ************************/
+static int zp_cmp_low(const zp_dig_t *a, const zp_dig_t *b, int digs);
+static zp_dig_t zp_sub_low(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, int digs);
+static void zp_add_mod(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f);
+static void zp_sub_mod(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f);
+static void zp_mont_mul(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f);
+static void zp_acc_mul(zp_dig_t *acc, const zp_dig_t *a, const zp_dig_t *b, int digs);
+static void zp_acc_reduce(zp_dig_t *c, zp_dig_t *acc, const zp_field_st *f);
+static bool zp_is_zero(const zp_dig_t *a, int digs);
+/****************************************************************************/
+
+bool zp_field_init(zp_field_t field)
+{
+  bool ret = false;
+  uint8_t bin[ZP_DIGS * sizeof(zp_dig_t)];
+  zp_dig_t acc[ZP_DIGS] = {0};
+  bn_t order;
+
+  bn_null(order);
+
+  RLC_TRY {
+    bn_new(order);
+    pc_get_ord(order);
+
+    if (bn_bits(order) > (int)(ZP_DIGS * 64) || !bn_get_bit(order, 0)) {
+      fprintf(stderr, "zp_field_init(): unsupported group order\n");
+      RLC_THROW(ERR_NO_VALID);
+    }
+
+    bn_write_bin(bin, sizeof(bin), order);
+    memset(field, 0, sizeof(zp_field_st));
+    for (int i = 0; i < ZP_DIGS; i++)
+      for (int j = 0; j < 8; j++)
+        field->prime[i] |= (zp_dig_t)bin[sizeof(bin) - 1 - (8 * i + j)] << (8 * j);
+
+    field->digs = (bn_bits(order) + 63) / 64;
+
+    /* Newton iteration: inverse of prime[0] modulo 2^64 */
+    zp_dig_t inv = field->prime[0];
+    for (int i = 0; i < 5; i++) inv *= 2 - field->prime[0] * inv;
+    field->u = -inv;
+
+    /* Powers of 2 modulo p by successive doublings: R, 2^64 * R and R^2 */
+    acc[0] = 1;
+    for (int i = 1; i <= 128 * field->digs; i++) {
+      zp_add_mod(acc, acc, acc, field);
+      if (i == 64 * field->digs) memcpy(field->one, acc, sizeof(acc));
+      if (i == 64 * (field->digs + 1)) memcpy(field->lazy, acc, sizeof(acc));
+    }
+    memcpy(field->r2, acc, sizeof(acc));
+
+    ret = true;
+  }
+  RLC_CATCH_ANY {
+    ret = false;
+  }
+  RLC_FINALLY {
+    bn_free(order);
+  }
+
+  return ret;
+}
+
+void zp_from_bn(zp_elt_t c, const bn_t a, const zp_field_t field)
+{
+  uint8_t bin[ZP_DIGS * sizeof(zp_dig_t)];
+  zp_elt_t t = {0};
+
+  bn_write_bin(bin, sizeof(bin), a);
+  for (int i = 0; i < ZP_DIGS; i++)
+    for (int j = 0; j < 8; j++)
+      t[i] |= (zp_dig_t)bin[sizeof(bin) - 1 - (8 * i + j)] << (8 * j);
+
+  zp_mont_mul(c, t, field->r2, field);
+}
+
+void zp_to_bn(bn_t c, const zp_elt_t a, const zp_field_t field)
+{
+  uint8_t bin[ZP_DIGS * sizeof(zp_dig_t)];
+  zp_elt_t t, plain_one = {1};
+
+  zp_mont_mul(t, a, plain_one, field);
+  for (int i = 0; i < ZP_DIGS; i++)
+    for (int j = 0; j < 8; j++)
+      bin[sizeof(bin) - 1 - (8 * i + j)] = (uint8_t)(t[i] >> (8 * j));
+
+  bn_read_bin(c, bin, sizeof(bin));
+}
+
+void zp_mul(zp_elt_t c, const zp_elt_t a, const zp_elt_t b, const zp_field_t field)
+{
+  zp_mont_mul(c, a, b, field);
+}
+
+/* Inverse by Fermat's little theorem: a^(p-2), a in Montgomery form */
+bool zp_inv(zp_elt_t c, const zp_elt_t a, const zp_field_t field)
+{
+  zp_elt_t e = {0}, r, two = {2};
+  const int digs = field->digs;
+
+  if (zp_is_zero(a, digs)) return false;
+
+  zp_sub_low(e, field->prime, two, digs);
+  memcpy(r, field->one, sizeof(zp_elt_t));
+
+  for (int i = 64 * digs - 1; i >= 0; i--) {
+    zp_mont_mul(r, r, r, field);
+    if ((e[i / 64] >> (i % 64)) & 1) zp_mont_mul(r, r, a, field);
+  }
+  memcpy(c, r, sizeof(zp_elt_t));
+
+  return true;
+}
+
+bool zp_mat_init(zp_mat_t mat, uint8_t dim)
+{
+  mat->dim = dim;
+  mat->entries = NULL;
+
+  if (dim == 0) return false;
+
+  if ((mat->entries = calloc(dim * dim, sizeof(zp_elt_t))) == NULL) {
+    mat->dim = 0;
+    return _error_alloc_fail_();
+  }
+
+  return true;
+}
+
+/*
+ * Uniform sampling by rejection. A uniform value of [0, p) is also uniform
+ * once read in Montgomery form, so no conversion is needed.
+ */
+void zp_mat_rand(zp_mat_t mat, const zp_field_t field)
+{
+  const int digs = field->digs;
+  const int top_bits = 64 - __builtin_clzll(field->prime[digs - 1]);
+  const zp_dig_t mask = (top_bits == 64) ? ~(zp_dig_t)0 : (((zp_dig_t)1 << top_bits) - 1);
+
+  for (int i = 0; i < zp_mat_dim(mat) * zp_mat_dim(mat); i++) {
+    memset(mat->entries[i], 0, sizeof(zp_elt_t));
+    do {
+      rand_bytes((uint8_t *)mat->entries[i], digs * sizeof(zp_dig_t));
+      mat->entries[i][digs - 1] &= mask;
+    } while (zp_cmp_low(mat->entries[i], field->prime, digs) != RLC_LT);
+  }
+}
+
+void zp_mat_transpose(zp_mat_t mat)
+{
+  zp_elt_t tmp;
+
+  for (uint8_t i = 0; i < zp_mat_dim(mat); i++) {
+    for (uint8_t j = i + 1; j < zp_mat_dim(mat); j++) {
+      memcpy(tmp, ZP_GET(mat, i, j), sizeof(zp_elt_t));
+      memcpy(ZP_GET(mat, i, j), ZP_GET(mat, j, i), sizeof(zp_elt_t));
+      memcpy(ZP_GET(mat, j, i), tmp, sizeof(zp_elt_t));
+    }
+  }
+}
+
+void zp_mat_product(zp_mat_t dest, const zp_mat_t A, const zp_mat_t B, const zp_field_t field)
+{
+  uint8_t dim = zp_mat_dim(A);
+  zp_dig_t acc[ZP_ACC_DIGS];
+
+  if (dim == 0 || dim != zp_mat_dim(B) || dim != zp_mat_dim(dest)) return;
+
+  for (uint8_t i = 0; i < dim; i++) {
+    for (uint8_t j = 0; j < dim; j++) {
+      memset(acc, 0, sizeof(acc));
+      for (uint8_t k = 0; k < dim; k++)
+        zp_acc_mul(acc, ZP_GET(A, i, k), ZP_GET(B, k, j), field->digs);
+      zp_acc_reduce(ZP_GET(dest, i, j), acc, field);
+    }
+  }
+}
+
+/*
+ * Gauss-Jordan elimination on [src | I]. In Zp any non-zero pivot is exact,
+ * there is no need for the partial pivoting heuristics of LU_decompose().
+ */
+bool zp_mat_invert(zp_mat_t dest, const zp_mat_t src, const zp_field_t field)
+{
+  const uint8_t dim = zp_mat_dim(src);
+  const int digs = field->digs;
+  const int width = 2 * dim;
+  zp_elt_t *aug, factor, tmp;
+
+  if (dim == 0 || dim != zp_mat_dim(dest)) return false;
+
+  if ((aug = calloc(dim * width, sizeof(zp_elt_t))) == NULL)
+    return _error_alloc_fail_();
+
+#define AUG(i, j)   aug[(i) * width + (j)]
+
+  for (uint8_t i = 0; i < dim; i++) {
+    memcpy(&AUG(i, 0), &ZP_GET(src, i, 0), dim * sizeof(zp_elt_t));
+    memcpy(AUG(i, dim + i), field->one, sizeof(zp_elt_t));
+  }
+
+  for (int col = 0; col < dim; col++) {
+    int pivot = col;
+    while (pivot < dim && zp_is_zero(AUG(pivot, col), digs)) pivot++;
+
+    if (pivot == dim) {
+      free(aug);
+      return false;   /* singular matrix */
+    }
+
+    if (pivot != col) {
+      for (int j = col; j < width; j++) {
+        memcpy(tmp, AUG(col, j), sizeof(zp_elt_t));
+        memcpy(AUG(col, j), AUG(pivot, j), sizeof(zp_elt_t));
+        memcpy(AUG(pivot, j), tmp, sizeof(zp_elt_t));
+      }
+    }
+
+    /* Normalize the pivot row, columns on the left of col are already zero */
+    zp_inv(factor, AUG(col, col), field);
+    memcpy(AUG(col, col), field->one, sizeof(zp_elt_t));
+    for (int j = col + 1; j < width; j++)
+      zp_mont_mul(AUG(col, j), AUG(col, j), factor, field);
+
+    for (int i = 0; i < dim; i++) {
+      if (i == col || zp_is_zero(AUG(i, col), digs)) continue;
+
+      memcpy(factor, AUG(i, col), sizeof(zp_elt_t));
+      memset(AUG(i, col), 0, sizeof(zp_elt_t));
+      for (int j = col + 1; j < width; j++) {
+        zp_mont_mul(tmp, factor, AUG(col, j), field);
+        zp_sub_mod(AUG(i, j), AUG(i, j), tmp, field);
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < dim; i++)
+    memcpy(&ZP_GET(dest, i, 0), &AUG(i, dim), dim * sizeof(zp_elt_t));
+
+#undef AUG
+
+  free(aug);
+  return true;
+}
+
+/* Export to a bn_t matrix (standard form), dest must be initialized */
+bool zp_mat_export(mat_t dest, const zp_mat_t src, const zp_field_t field)
+{
+  if (mat_dim(dest) != zp_mat_dim(src)) return false;
+
+  for (int i = 0; i < zp_mat_dim(src) * zp_mat_dim(src); i++)
+    zp_to_bn(dest->entries[i], src->entries[i], field);
+
+  return true;
+}
+
+/*
+ * Same contract as mat_rand_dual_mat(): mat and dual_mat are initialized here
+ * and must be cleared by the caller. The dual matrix is (mat^(-1))^T, which is
+ * exact by construction, so the result is not verified again.
+ */
+bool zp_mat_rand_dual_mat(mat_t mat, mat_t dual_mat, uint8_t dim)
+{
+  bool ret = false;
+  zp_field_t field;
+  zp_mat_t A, inv_A;
+
+  mat->dim = dual_mat->dim = 0;
+  if (!zp_field_init(field)) return false;
+
+  /* Both are initialized before the test, so that both can be cleared */
+  bool is_init = zp_mat_init(A, dim);
+  is_init = zp_mat_init(inv_A, dim) && is_init;
+
+  if (is_init)
+  {
+    do { zp_mat_rand(A, field); } while (!zp_mat_invert(inv_A, A, field));
+    zp_mat_transpose(inv_A);
+
+    if (mat_init(mat, dim) && mat_init(dual_mat, dim)) {
+      ret = zp_mat_export(mat, A, field) && zp_mat_export(dual_mat, inv_A, field);
+    }
+  }
+
+  zp_mat_clear(A);
+  zp_mat_clear(inv_A);
+
+  return ret;
+}
+
+void zp_mat_clear(zp_mat_t mat)
+{
+  if (mat->entries) {
+    memset(mat->entries, 0, zp_mat_dim(mat) * zp_mat_dim(mat) * sizeof(zp_elt_t));
+    free(mat->entries);
+    mat->entries = NULL;
+  }
+  mat->dim = 0;
+}
+
+/*****************************************************************************
+****************************** STATIC FUNCTIONS ******************************
+******************************************************************************/
+
+static int zp_cmp_low(const zp_dig_t *a, const zp_dig_t *b, int digs)
+{
+  for (int i = digs - 1; i >= 0; i--) {
+    if (a[i] != b[i]) return (a[i] > b[i]) ? RLC_GT : RLC_LT;
+  }
+  return RLC_EQ;
+}
+
+static bool zp_is_zero(const zp_dig_t *a, int digs)
+{
+  zp_dig_t t = 0;
+  for (int i = 0; i < digs; i++) t |= a[i];
+  return t == 0;
+}
+
+/* c = a - b, returns the borrow */
+static zp_dig_t zp_sub_low(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, int digs)
+{
+  zp_dig_t borrow = 0;
+  for (int i = 0; i < digs; i++) {
+    zp_dbl_t t = (zp_dbl_t)a[i] - b[i] - borrow;
+    c[i] = (zp_dig_t)t;
+    borrow = (zp_dig_t)(t >> 64) & 1;
+  }
+  return borrow;
+}
+
+static void zp_add_mod(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f)
+{
+  zp_dig_t carry = 0;
+  for (int i = 0; i < f->digs; i++) {
+    zp_dbl_t t = (zp_dbl_t)a[i] + b[i] + carry;
+    c[i] = (zp_dig_t)t;
+    carry = (zp_dig_t)(t >> 64);
+  }
+  if (carry || zp_cmp_low(c, f->prime, f->digs) != RLC_LT)
+    zp_sub_low(c, c, f->prime, f->digs);
+}
+
+static void zp_sub_mod(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f)
+{
+  if (zp_sub_low(c, a, b, f->digs)) {
+    zp_dig_t carry = 0;
+    for (int i = 0; i < f->digs; i++) {
+      zp_dbl_t t = (zp_dbl_t)c[i] + f->prime[i] + carry;
+      c[i] = (zp_dig_t)t;
+      carry = (zp_dig_t)(t >> 64);
+    }
+  }
+}
+
+/* Montgomery multiplication (CIOS): c = a * b / R mod p, with a, b < p */
+static void zp_mont_mul(zp_dig_t *c, const zp_dig_t *a, const zp_dig_t *b, const zp_field_st *f)
+{
+  const int digs = f->digs;
+  zp_dig_t t[ZP_DIGS + 2] = {0};
+  zp_dig_t carry, m;
+  zp_dbl_t uv;
+
+  for (int i = 0; i < digs; i++) {
+    carry = 0;
+    for (int j = 0; j < digs; j++) {
+      uv = (zp_dbl_t)a[j] * b[i] + t[j] + carry;
+      t[j] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+    uv = (zp_dbl_t)t[digs] + carry;
+    t[digs] = (zp_dig_t)uv;
+    t[digs + 1] = (zp_dig_t)(uv >> 64);
+
+    m = t[0] * f->u;
+    uv = (zp_dbl_t)m * f->prime[0] + t[0];
+    carry = (zp_dig_t)(uv >> 64);
+    for (int j = 1; j < digs; j++) {
+      uv = (zp_dbl_t)m * f->prime[j] + t[j] + carry;
+      t[j - 1] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+    uv = (zp_dbl_t)t[digs] + carry;
+    t[digs - 1] = (zp_dig_t)uv;
+    t[digs] = t[digs + 1] + (zp_dig_t)(uv >> 64);
+  }
+
+  /* t < 2p */
+  if (t[digs] || zp_cmp_low(t, f->prime, digs) != RLC_LT)
+    zp_sub_low(t, t, f->prime, digs);
+
+  memset(c, 0, sizeof(zp_elt_t));
+  memcpy(c, t, digs * sizeof(zp_dig_t));
+}
+
+/* acc += a * b, without any reduction */
+static void zp_acc_mul(zp_dig_t *acc, const zp_dig_t *a, const zp_dig_t *b, int digs)
+{
+  zp_dig_t carry;
+  zp_dbl_t uv;
+
+  for (int i = 0; i < digs; i++) {
+    carry = 0;
+    for (int j = 0; j < digs; j++) {
+      uv = (zp_dbl_t)a[j] * b[i] + acc[i + j] + carry;
+      acc[i + j] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+    for (int k = i + digs; carry != 0 && k < ZP_ACC_DIGS; k++) {
+      uv = (zp_dbl_t)acc[k] + carry;
+      acc[k] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+  }
+}
+
+/*
+ * Lazy reduction of a sum of less than 2^64 products of Montgomery elements.
+ * Running digs + 1 rounds of Montgomery reduction leaves a value lower than 2p
+ * whatever the number of products is, the extra 2^(-64) factor is then removed
+ * by a Montgomery multiplication with 2^64 * R.
+ */
+static void zp_acc_reduce(zp_dig_t *c, zp_dig_t *acc, const zp_field_st *f)
+{
+  const int digs = f->digs;
+  zp_dig_t carry, m, t[ZP_DIGS + 1];
+  zp_dbl_t uv;
+
+  for (int i = 0; i <= digs; i++) {
+    m = acc[i] * f->u;
+    carry = 0;
+    for (int j = 0; j < digs; j++) {
+      uv = (zp_dbl_t)m * f->prime[j] + acc[i + j] + carry;
+      acc[i + j] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+    for (int k = i + digs; carry != 0 && k < ZP_ACC_DIGS; k++) {
+      uv = (zp_dbl_t)acc[k] + carry;
+      acc[k] = (zp_dig_t)uv;
+      carry = (zp_dig_t)(uv >> 64);
+    }
+  }
+
+  memcpy(t, acc + digs + 1, (digs + 1) * sizeof(zp_dig_t));
+  if (t[digs] || zp_cmp_low(t, f->prime, digs) != RLC_LT)
+    zp_sub_low(t, t, f->prime, digs);
+
+  zp_mont_mul(c, t, f->lazy, f);
+}
@@ -5,10 +5,14 @@
 #include <sstream>
 #include <string>
 #include <math.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 #include <abe_lsss/abe_lsss.h>
 
 #include "kpabe.hpp"
+#include "attribute_interner.hpp"
+#include "policy_program.hpp"
+#include "md_batch.hpp"
 
 
 using namespace std;
@@ -90,11 +94,19 @@ protected:
     MSK = "testMSK";
     AUTH1MPK = "auth1", AUTH1MSK = "auth1MSK";
     AUTH2MPK = "auth2", AUTH2MSK = "auth2MSK";
+    dk_filename = testing::TempDir() + "test_abe_dk.map";
+  }
+
+  // The mapped key is removed even when an assertion fails
+  virtual void TearDown() {
+    remove(dk_filename.c_str());
+    remove((dk_filename + ".tmp").c_str());
   }
 
   ByteString mpkBlob, mskBlob, dkBlob, ctBlob;
   ByteString plaintext, plaintext1;
   string MPK, MSK, AUTH1MPK, AUTH1MSK, AUTH2MPK, AUTH2MSK;
+  string dk_filename;
 };
 
 class CCASecurityForKEMTest : public SecurityForSchemeTest {};
@@ -122,6 +134,13 @@ TEST_P(SecurityForSchemeTest, testWorkingExamples) {
   mpk.serialize(mpkBlob); ASSERT_TRUE(mpkBlob.size() == mpk.getSizeInBytes());
   msk.serialize(mskBlob); ASSERT_TRUE(mskBlob.size() == msk.getSizeInBytes());
 
+  // Direct serialization into a buffer gives the same bytes
+  vector<uint8_t> mpkBuffer(mpk.getSizeInBytes()), mskBuffer(msk.getSizeInBytes());
+  ASSERT_TRUE(mpk.serializeToSpan(mpkBuffer) == mpkBlob.size());
+  ASSERT_TRUE(memcmp(mpkBuffer.data(), mpkBlob.data(), mpkBlob.size()) == 0);
+  ASSERT_TRUE(msk.serializeToSpan(mskBuffer) == mskBlob.size());
+  ASSERT_TRUE(memcmp(mskBuffer.data(), mskBlob.data(), mskBlob.size()) == 0);
+
   // Load master public and secret keys from bytes - Deserialize
   // Check that the loaded keys are equal to the origal exported keys
   KPABE_DPVS_PUBLIC_KEY mpk2;
@@ -130,6 +149,11 @@ TEST_P(SecurityForSchemeTest, testWorkingExamples) {
   mpk2.deserialize(mpkBlob); ASSERT_TRUE(mpk == mpk2);
   msk2.deserialize(mskBlob); ASSERT_TRUE(msk == msk2);
 
+  // A randomized public key is validated with its scalar only
+  auto [mpk3, k] = mpk.randomize();
+  ASSERT_TRUE(mpk.validate_derived_key(mpk3, k));
+  ASSERT_FALSE(mpk.validate_derived_key(mpk3, k + k));
+
   // Encrypt under the specified functional input - Attributes list
   // Here we check just if the attributes list is well formed
   unique_ptr<OpenABEFunctionInput> encInput = createAttributeList(input.attributes);
@@ -146,9 +170,65 @@ TEST_P(SecurityForSchemeTest, testWorkingExamples) {
   ASSERT_TRUE(is_dk_ok);
   dk->serialize(dkBlob); ASSERT_TRUE(dkBlob.size() == dk->getSizeInBytes());
 
+  vector<uint8_t> dkBuffer(dk->getSizeInBytes());
+  ASSERT_TRUE(dk->serializeToSpan(dkBuffer) == dkBlob.size());
+  ASSERT_TRUE(memcmp(dkBuffer.data(), dkBlob.data(), dkBlob.size()) == 0);
+
   KPABE_DPVS_DECRYPTION_KEY dk2;
   dk2.deserialize(dkBlob); ASSERT_TRUE(*dk == dk2);
 
+  // Format v2, in a buffer or streamed, is read back by deserialize
+  vector<uint8_t> dkV2;
+  dk->serializeV2(dkV2); ASSERT_TRUE(dkV2.size() == dk->getSizeInBytesV2());
+  stringstream dkV2Stream;
+  dk->serializeV2(dkV2Stream);
+  ASSERT_TRUE(dkV2Stream.str() == string(dkV2.begin(), dkV2.end()));
+  KPABE_DPVS_DECRYPTION_KEY dk6;
+  dk6.deserialize(dkV2); ASSERT_TRUE(*dk == dk6);
+
+  // A stream is read entry by entry, and no further than the key
+  dk->serialize(dkV2Stream);
+  KPABE_DPVS_DECRYPTION_KEY dk7, dk8;
+  dk7.deserialize(dkV2Stream); ASSERT_TRUE(*dk == dk7);
+  dk8.deserialize(dkV2Stream); ASSERT_TRUE(*dk == dk8);
+  ASSERT_TRUE(dkV2Stream.peek() == EOF);
+
+  // Truncated input is refused the same way from a stream and from a fd
+  string dkV2Truncated(dkV2.begin(), dkV2.begin() + dkV2.size() / 2);
+  stringstream dkTruncatedStream(dkV2Truncated);
+  KPABE_DPVS_DECRYPTION_KEY dk11;
+  ASSERT_FALSE(dk11.deserialize(dkTruncatedStream));
+
+  int fds[2];
+  ASSERT_TRUE(pipe(fds) == 0);
+  ASSERT_TRUE(write(fds[1], dkV2Truncated.data(), dkV2Truncated.size()) == (ssize_t)dkV2Truncated.size());
+  close(fds[1]);
+  ASSERT_FALSE(dk11.deserializeFromFd(fds[0]));
+  close(fds[0]);
+
+  // Parallel decoding gives the same key, in both formats
+  KPABE_DPVS_DECRYPTION_KEY dk9, dk10;
+  dk9.set_parallel_decoding(true); dk10.set_parallel_decoding(true);
+  dk9.deserialize(dkBlob); ASSERT_TRUE(*dk == dk9);
+  dk10.deserialize(dkV2); ASSERT_TRUE(*dk == dk10);
+
+  // Uncompressed points are recorded in the output and read back
+  KPABE_DPVS_DECRYPTION_KEY dk4 = *dk;
+  dk4.set_compression(false);
+  vector<uint8_t> dk4Buffer;
+  dk4.serialize(dk4Buffer); ASSERT_TRUE(dk4Buffer.size() == dk4.getSizeInBytes());
+  ASSERT_TRUE(dk4Buffer.size() > dkBlob.size());
+  KPABE_DPVS_DECRYPTION_KEY dk5;
+  dk5.deserialize(dk4Buffer);
+  ASSERT_FALSE(dk5.is_compressed()); ASSERT_TRUE(*dk == dk5);
+
+  // A lazy key keeps the encoded entries, and gives them back unchanged
+  KPABE_DPVS_DECRYPTION_KEY dk3;
+  dk3.set_lazy_decoding(true, 2);
+  dk3.deserialize(dkBlob); ASSERT_TRUE(*dk == dk3);
+  vector<uint8_t> dk3Buffer(dk3.getSizeInBytes());
+  ASSERT_TRUE(dk3.serializeToSpan(dk3Buffer) == dkBlob.size());
+  ASSERT_TRUE(memcmp(dk3Buffer.data(), dkBlob.data(), dkBlob.size()) == 0);
 
   // Encryption & Decryption
   uint8_t sym_key_1[RLC_MD_LEN];
@@ -157,6 +237,68 @@ TEST_P(SecurityForSchemeTest, testWorkingExamples) {
   KPABE_DPVS_CIPHERTEXT ciphertext(input.attributes, input.url);
   ASSERT_TRUE(ciphertext.encrypt(sym_key_1, mpk));
 
+  ciphertext.serialize(ctBlob); ASSERT_TRUE(ctBlob.size() == ciphertext.getSizeInBytes());
+  vector<uint8_t> ctBuffer(ciphertext.getSizeInBytes());
+  ASSERT_TRUE(ciphertext.serializeToSpan(ctBuffer) == ctBlob.size());
+  ASSERT_TRUE(memcmp(ctBuffer.data(), ctBlob.data(), ctBlob.size()) == 0);
+
+  vector<uint8_t> ctV2;
+  ciphertext.serializeV2(ctV2); ASSERT_TRUE(ctV2.size() == ciphertext.getSizeInBytesV2());
+  KPABE_DPVS_CIPHERTEXT ciphertext3;
+  ciphertext3.deserialize(ctV2);
+  ASSERT_TRUE(ciphertext3.get_ctx_root() == ciphertext.get_ctx_root());
+  ASSERT_TRUE(ciphertext3.get_ctx_bl() == ciphertext.get_ctx_bl());
+
+  // Points are checked on deserialize, trusted inputs may skip the check
+  ASSERT_TRUE(ciphertext.is_valid()); ASSERT_TRUE(dk->is_valid());
+  KPABE_DPVS_CIPHERTEXT ciphertext4;
+  ciphertext4.set_validation(false);
+  ciphertext4.deserialize(ctBuffer);
+  ASSERT_TRUE(ciphertext4.get_ctx_wl() == ciphertext.get_ctx_wl());
+
+  // The compact format drops the names, the receiver gives the url and attributes
+  vector<uint8_t> ctCompact;
+  ciphertext.serializeCompact(ctCompact);
+  ASSERT_TRUE(ctCompact.size() == ciphertext.getCompactSizeInBytes());
+  ASSERT_TRUE(ctCompact.size() < ctBlob.size());
+
+  auto attributes_list = createAttributeList(input.attributes);
+  KPABE_DPVS_CIPHERTEXT ciphertext2;
+  ASSERT_FALSE(ciphertext2.deserializeCompact(ctCompact, "www.other-url.com", *attributes_list->getAttributeList()));
+  ASSERT_TRUE(ciphertext2.deserializeCompact(ctCompact, input.url, *attributes_list->getAttributeList()));
+  ASSERT_TRUE(ciphertext2.get_ctx_root() == ciphertext.get_ctx_root());
+
+  // A truncated compact ciphertext is refused and leaves the previous one
+  for (size_t len : {ctCompact.size() / 2, ctCompact.size() - 1}) {
+    span<const uint8_t> truncated(ctCompact.data(), len);
+    ASSERT_FALSE(ciphertext2.deserializeCompact(truncated, input.url, *attributes_list->getAttributeList()));
+    ASSERT_TRUE(ciphertext2.get_ctx_root() == ciphertext.get_ctx_root());
+  }
+  for (const auto& att : *attributes_list->getAttributeList()) {
+    auto ctx_att = ciphertext.get_ctx_att(OpenABEHashKey(att));
+    ASSERT_TRUE(ctx_att != nullptr);
+    ASSERT_TRUE(*ciphertext2.get_ctx_att(OpenABEHashKey(att)) == *ctx_att);
+    ASSERT_TRUE(*ciphertext3.get_ctx_att(OpenABEHashKey(att)) == *ctx_att);
+  }
+
+  // The compiled policy agrees with the LSSS, and selects a satisfying subset
+  PolicyProgram program(input.policy);
+  AttributeSet attribute_set(input.attributes), selected_set;
+  vector<attribute_id_t> selected;
+  OpenABELSSS lsss;
+  auto policy_tree = createPolicyTree(input.policy);
+  bool is_satisfied = lsss.recoverCoefficients(policy_tree.get(), attributes_list.get());
+  ASSERT_FALSE(program.empty());
+  ASSERT_TRUE(program.is_satisfied(attribute_set) == is_satisfied);
+  ASSERT_TRUE(program.select(attribute_set, selected) == is_satisfied);
+  for (attribute_id_t id : selected) {
+    ASSERT_TRUE(attribute_set.contains(id));
+    selected_set.insert(id);
+  }
+  ASSERT_TRUE(program.is_satisfied(selected_set) == is_satisfied);
+
+  // The key holds its compiled policy
+  ASSERT_FALSE(dk->get_policy_program().empty());
 
   // Decrypt the ciphertext with multiple keys
   ASSERT_TRUE(ciphertext.decrypt(sym_key_2, *dk) == input.expect_pass);
@@ -166,6 +308,48 @@ TEST_P(SecurityForSchemeTest, testWorkingExamples) {
     ASSERT_FALSE(memcmp(sym_key_1, sym_key_2, RLC_MD_LEN) == 0);
   }
 
+  ASSERT_TRUE(ciphertext.decrypt(sym_key_2, dk3) == input.expect_pass);
+  if (input.expect_pass) {
+    ASSERT_TRUE(memcmp(sym_key_1, sym_key_2, RLC_MD_LEN) == 0);
+  }
+
+  ASSERT_TRUE(ciphertext2.decrypt(sym_key_2, *dk) == input.expect_pass);
+  if (input.expect_pass) {
+    ASSERT_TRUE(memcmp(sym_key_1, sym_key_2, RLC_MD_LEN) == 0);
+  }
+
+  // The same key, mapped from a file, decrypts the same way
+  ASSERT_TRUE(KPABE_DPVS_MAPPED_DECRYPTION_KEY::write(*dk, dk_filename));
+  KPABE_DPVS_MAPPED_DECRYPTION_KEY mapped_dk(dk_filename);
+  ASSERT_TRUE(mapped_dk.is_open());
+  ASSERT_TRUE(mapped_dk.get_key_root() == dk->get_key_root());
+
+  uint8_t sym_key_3[RLC_MD_LEN];
+  ASSERT_TRUE(ciphertext.decrypt(sym_key_3, mapped_dk) == input.expect_pass);
+  if (input.expect_pass) {
+    ASSERT_TRUE(memcmp(sym_key_1, sym_key_3, RLC_MD_LEN) == 0);
+  }
+  ASSERT_FALSE(mapped_dk.get_policy_program().empty());
+  ASSERT_TRUE(mapped_dk.get_nb_key_bl() ==
+              (size_t)distance(dk->get_key_bl_begin(), dk->get_key_bl_end()));
+  mapped_dk.close();
+
+  // Urls are hashed where they are used, they are not interned
+  ASSERT_TRUE(AttributeInterner::global().find(input.url) == nullptr);
+
+  // A ciphertext of a randomized public key is decrypted with the randomizer,
+  // as when the scalar is removed from the ciphertext first
+  uint8_t sym_key_4[RLC_MD_LEN], sym_key_5[RLC_MD_LEN], sym_key_6[RLC_MD_LEN];
+  KPABE_DPVS_CIPHERTEXT ciphertext5(input.attributes, input.url);
+  ASSERT_TRUE(ciphertext5.encrypt(sym_key_4, mpk3));
+  ASSERT_TRUE(ciphertext5.decrypt(sym_key_5, *dk, k) == input.expect_pass);
+  ciphertext5.remove_scalar(k);
+  ASSERT_TRUE(ciphertext5.decrypt(sym_key_6, *dk) == input.expect_pass);
+  if (input.expect_pass) {
+    ASSERT_TRUE(memcmp(sym_key_4, sym_key_5, RLC_MD_LEN) == 0);
+    ASSERT_TRUE(memcmp(sym_key_4, sym_key_6, RLC_MD_LEN) == 0);
+  }
+
   if (input.verbose) {
     ByteString sym_key_1_Blob, sym_key_2_Blob;
     sym_key_1_Blob.appendArray(sym_key_1, RLC_MD_LEN);
@@ -294,6 +478,379 @@ INSTANTIATE_TEST_SUITE_P(CheckSat1, CheckIfSatisfiedTests,
 #endif
 
 
+/* Interned labels keep their entry, and the values derived from them */
+TEST(AttributeInternerTest, InternKeepsEntries) {
+  AttributeInterner& interner = AttributeInterner::global();
+  string label = "A1";
+  const InternedAttribute& interned = interner.intern(label);
+  ASSERT_TRUE(&interner.intern(label) == &interned);
+  ASSERT_TRUE(interner.get(interned.id).name == label);
+  ASSERT_TRUE(interned.hash_key == OpenABEHashKey(label));
+
+  BPGroup group;
+  ASSERT_TRUE(interned.zp == hashToZP(label, group.order));
+  ASSERT_THROW(interner.get(interner.size()), std::out_of_range);
+}
+
+/* The names of a ciphertext are looked up only, those which are not interned
+   are skipped */
+TEST(AttributeInternerTest, UnknownNamesAreNotInterned) {
+  PolicyProgram program("A1 and A2");
+  size_t interned_size = AttributeInterner::global().size();
+  AttributeSet unknown_set(vector<string>{"never-interned-attribute"});
+  ASSERT_FALSE(program.is_satisfied(unknown_set));
+  ASSERT_TRUE(AttributeInterner::global().find("never-interned-attribute") == nullptr);
+  ASSERT_TRUE(AttributeInterner::global().size() == interned_size);
+}
+
+/* Montgomery arithmetic of zp_matrix.c, checked against the bn_t arithmetic */
+TEST(ZpMatrixTest, MulAndInverseMatchRelic) {
+  zp_field_t field;
+  ASSERT_TRUE(zp_field_init(field));
+
+  bn_t order, a, b, c, d;
+  bn_null(order); bn_null(a); bn_null(b); bn_null(c); bn_null(d);
+  bn_new(order); bn_new(a); bn_new(b); bn_new(c); bn_new(d);
+  pc_get_ord(order);
+
+  zp_elt_t za, zb, zc;
+
+  // Zero has no inverse
+  bn_zero(a);
+  zp_from_bn(za, a, field);
+  ASSERT_FALSE(zp_inv(zc, za, field));
+
+  for (int i = 0; i < 100; i++) {
+    // 1 and p - 1 first, then random values
+    if (i == 0) bn_set_dig(a, 1);
+    else if (i == 1) { bn_set_dig(a, 1); bn_sub(a, order, a); }
+    else bn_rand_mod(a, order);
+    bn_rand_mod(b, order);
+
+    zp_from_bn(za, a, field);
+    zp_from_bn(zb, b, field);
+    zp_to_bn(c, za, field);
+    ASSERT_TRUE(bn_cmp(c, a) == RLC_EQ);
+
+    zp_mul(zc, za, zb, field);
+    zp_to_bn(c, zc, field);
+    bn_mul(d, a, b); bn_mod(d, d, order);
+    ASSERT_TRUE(bn_cmp(c, d) == RLC_EQ);
+
+    if (bn_is_zero(a)) continue;
+    ASSERT_TRUE(zp_inv(zc, za, field));
+    zp_to_bn(c, zc, field);
+    bn_mod_inv(d, a, order);
+    ASSERT_TRUE(bn_cmp(c, d) == RLC_EQ);
+  }
+
+  bn_free(order); bn_free(a); bn_free(b); bn_free(c); bn_free(d);
+}
+
+TEST(ZpMatrixTest, InverseAndDualMatrix) {
+  zp_field_t field;
+  ASSERT_TRUE(zp_field_init(field));
+
+  for (uint8_t dim : {1, 3, 6, 8}) {
+    zp_mat_t A, inv_A, P;
+    ASSERT_TRUE(zp_mat_init(A, dim));
+    ASSERT_TRUE(zp_mat_init(inv_A, dim));
+    ASSERT_TRUE(zp_mat_init(P, dim));
+
+    do { zp_mat_rand(A, field); } while (!zp_mat_invert(inv_A, A, field));
+
+    // A * inv_A = I, read back in standard form
+    bn_t e; bn_null(e); bn_new(e);
+    zp_mat_product(P, A, inv_A, field);
+    for (uint8_t i = 0; i < dim; i++) {
+      for (uint8_t j = 0; j < dim; j++) {
+        zp_to_bn(e, ZP_GET(P, i, j), field);
+        if (i == j) ASSERT_TRUE(bn_cmp_dig(e, 1) == RLC_EQ);
+        else ASSERT_TRUE(bn_is_zero(e));
+      }
+    }
+    bn_free(e);
+
+    zp_mat_clear(A); zp_mat_clear(inv_A); zp_mat_clear(P);
+
+    // A * (inv_A)^T = I for the exported pair, with the bn_t arithmetic
+    mat_t mat, dual_mat;
+    ASSERT_TRUE(zp_mat_rand_dual_mat(mat, dual_mat, dim));
+    ASSERT_TRUE(mat_is_dual_pair(mat, dual_mat));
+    mat_clear(mat); mat_clear(dual_mat);
+  }
+
+  // An empty dimension fails without touching uninitialized matrices
+  mat_t mat, dual_mat;
+  ASSERT_FALSE(zp_mat_rand_dual_mat(mat, dual_mat, 0));
+}
+
+
+/* Counts of the compact format are 16 bits, a larger ciphertext is refused */
+TEST(CompactCiphertextTest, TooManyAttributesThrow) {
+  KPABE_DPVS kpabe; ASSERT_TRUE(kpabe.setup());
+
+  uint8_t session_key[RLC_MD_LEN];
+  KPABE_DPVS_CIPHERTEXT ciphertext("A1", "www.perdu.com");
+  ASSERT_TRUE(ciphertext.encrypt(session_key, kpabe.get_public_key()));
+  ciphertext.set_compression(false);
+
+  // Format v2 ends with the count of attributes and their entries: the only
+  // entry is repeated under UINT16_MAX + 1 names, without encrypting them
+  vector<uint8_t> ctV2;
+  ciphertext.serializeV2(ctV2);
+  size_t points_size = NH * G1Vec<NH>::getPointSize(false);
+  size_t prefix_size = ctV2.size() - points_size - entry_size_v2(OpenABEHashKey("A1"), 0) - varint_size(1);
+  const uint8_t *points = ctV2.data() + ctV2.size() - points_size;
+
+  const size_t nb_att = UINT16_MAX + 1;
+  vector<uint8_t> bytes(ctV2.begin(), ctV2.begin() + prefix_size);
+  bytes.resize(prefix_size + varint_size(nb_att));
+  ByteWriter({bytes.data() + prefix_size, varint_size(nb_att)}).putVarint(nb_att);
+  for (size_t i = 0; i < nb_att; i++) {
+    string name = "A" + to_string(i);
+    size_t offset = bytes.size();
+    bytes.resize(offset + entry_size_v2(name, points_size));
+    ByteWriter writer({bytes.data() + offset, entry_size_v2(name, points_size)});
+    writer.putVarint(name.size());
+    writer.putBytes(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+    writer.putBytes(points, points_size);
+  }
+
+  KPABE_DPVS_CIPHERTEXT large;
+  large.set_validation(false);
+  large.deserialize(bytes);
+  ASSERT_TRUE(large.get_ctx_att("A" + to_string(nb_att - 1)) != nullptr);
+
+  vector<uint8_t> compact;
+  ASSERT_THROW(large.serializeCompact(compact), std::length_error);
+}
+
+/* Random point of the curve, outside G1 but with a negligible probability */
+static void g1_rand_on_curve(g1_t p)
+{
+  fp_t a, b, t;
+  fp_null(a); fp_null(b); fp_null(t);
+  fp_new(a); fp_new(b); fp_new(t);
+
+  ep_curve_get_a(a);
+  ep_curve_get_b(b);
+  do {
+    fp_rand(p->x);
+    fp_sqr(t, p->x);
+    fp_add(t, t, a);
+    fp_mul(t, t, p->x);
+    fp_add(t, t, b);
+  } while (!fp_srt(p->y, t));
+  fp_set_dig(p->z, 1);
+  p->coord = BASIC;
+
+  fp_free(a); fp_free(b); fp_free(t);
+}
+
+static void g2_rand_on_curve(g2_t q)
+{
+  fp2_t a, b, t;
+  fp2_null(a); fp2_null(b); fp2_null(t);
+  fp2_new(a); fp2_new(b); fp2_new(t);
+
+  ep2_curve_get_a(a);
+  ep2_curve_get_b(b);
+  do {
+    fp2_rand(q->x);
+    fp2_sqr(t, q->x);
+    fp2_add(t, t, a);
+    fp2_mul(t, t, q->x);
+    fp2_add(t, t, b);
+  } while (!fp2_srt(q->y, t));
+  fp2_set_dig(q->z, 1);
+  q->coord = BASIC;
+
+  fp2_free(a); fp2_free(b); fp2_free(t);
+}
+
+/* Replace the first occurrence of from by to, both of the same size */
+static bool replace_bytes(vector<uint8_t> &bytes, const vector<uint8_t> &from,
+                          const vector<uint8_t> &to)
+{
+  auto it = search(bytes.begin(), bytes.end(), from.begin(), from.end());
+  if (it == bytes.end() || from.size() != to.size()) return false;
+  copy(to.begin(), to.end(), it);
+  return true;
+}
+
+/* Points of the curve outside G1 or G2 are refused, not only most of them */
+TEST(SubgroupCheckTest, PointOutsideSubgroupIsRefused) {
+  KPABE_DPVS kpabe({"www.example.com"}, {"www.facebook.com"});
+  ASSERT_TRUE(kpabe.setup());
+  auto dk = kpabe.keygen("A1 and A2");
+  ASSERT_TRUE(dk.has_value());
+
+  uint8_t session_key[RLC_MD_LEN];
+  KPABE_DPVS_CIPHERTEXT ciphertext("A1|A2", "www.perdu.com");
+  ASSERT_TRUE(ciphertext.encrypt(session_key, kpabe.get_public_key()));
+
+  g1_t p; g2_t q;
+  g1_null(p); g2_null(q);
+  g1_new(p); g2_new(q);
+  g1_rand_on_curve(p);
+  g2_rand_on_curve(q);
+  ASSERT_TRUE(ep_on_curve(p) && !g1_is_valid(p));
+  ASSERT_TRUE(ep2_on_curve(q) && !g2_is_valid(q));
+
+  // The first point of ctx_root and of key_root is replaced in the encodings
+  bool cp = ciphertext.is_compressed();
+  vector<uint8_t> from(g1_size_bin(ciphertext.get_ctx_root().data()[0], cp));
+  vector<uint8_t> to(g1_size_bin(p, cp));
+  g1_write_bin(from.data(), from.size(), ciphertext.get_ctx_root().data()[0], cp);
+  g1_write_bin(to.data(), to.size(), p, cp);
+
+  vector<uint8_t> ctBuffer;
+  ciphertext.serialize(ctBuffer);
+  ASSERT_TRUE(replace_bytes(ctBuffer, from, to));
+
+  cp = dk->is_compressed();
+  from.resize(g2_size_bin(dk->get_key_root().data()[0], cp));
+  to.resize(g2_size_bin(q, cp));
+  g2_write_bin(from.data(), from.size(), dk->get_key_root().data()[0], cp);
+  g2_write_bin(to.data(), to.size(), q, cp);
+
+  vector<uint8_t> dkBuffer;
+  dk->serialize(dkBuffer);
+  ASSERT_TRUE(replace_bytes(dkBuffer, from, to));
+
+  g1_free(p); g2_free(q);
+
+  KPABE_DPVS_CIPHERTEXT ciphertext2;
+  ASSERT_ANY_THROW(ciphertext2.deserialize(ctBuffer));
+  ciphertext2.set_validation(false);
+  ciphertext2.deserialize(ctBuffer);
+  ASSERT_FALSE(ciphertext2.is_valid());
+
+  KPABE_DPVS_DECRYPTION_KEY dk2;
+  ASSERT_ANY_THROW(dk2.deserialize(dkBuffer));
+  dk2.set_validation(false);
+  dk2.deserialize(dkBuffer);
+  ASSERT_FALSE(dk2.is_valid());
+}
+
+
+static vector<uint8_t> g1_encoding(const g1_t p, bool compressed)
+{
+  vector<uint8_t> bytes(g1_size_bin(p, compressed));
+  g1_write_bin(bytes.data(), bytes.size(), p, compressed);
+  return bytes;
+}
+
+/* A derived public key with one point changed is refused, in G1 or not */
+TEST(DerivedKeyTest, TamperedPointIsRefused) {
+  KPABE_DPVS kpabe; ASSERT_TRUE(kpabe.setup());
+  const auto& mpk = kpabe.get_public_key();
+  auto [mpk2, k] = mpk.randomize();
+  ASSERT_TRUE(mpk.validate_derived_key(mpk2, k));
+
+  vector<uint8_t> mpkBuffer;
+  mpk2.serialize(mpkBuffer);
+  bool cp = mpk2.is_compressed();
+  vector<uint8_t> from = g1_encoding(mpk2.get_h3().data()[NH - 1], cp);
+
+  g1_t p, q;
+  g1_null(p); g1_null(q);
+  g1_new(p); g1_new(q);
+  g1_get_gen(p);
+  g1_rand_on_curve(q);
+
+  for (const g1_t *point : {&p, &q}) {
+    vector<uint8_t> tampered(mpkBuffer);
+    ASSERT_TRUE(replace_bytes(tampered, from, g1_encoding(*point, cp)));
+
+    KPABE_DPVS_PUBLIC_KEY mpk3;
+    mpk3.deserialize(tampered);
+    ASSERT_FALSE(mpk3 == mpk2);
+    ASSERT_FALSE(mpk.validate_derived_key(mpk3, k));
+  }
+
+  g1_free(p); g1_free(q);
+}
+
+
+/* Every kernel the cpu has gives the digests of md_map, on any length and batch size */
+TEST(MdBatchTest, KernelsMatchMdMap) {
+  vector<string> inputs;
+  for (size_t len = 0; len <= 200; len++) {
+    string input(len, 0);
+    for (size_t i = 0; i < len; i++) input[i] = (char)(i * 31 + len);
+    inputs.push_back(input);
+  }
+
+  // Lengths around the padding limits of one, two and three blocks
+  vector<string> edges;
+  for (size_t len : {55, 56, 63, 64, 119, 120, 0, 1, 127, 128, 183}) {
+    edges.push_back(inputs[len]);
+  }
+
+  for (const char *method : {"scalar", "avx2", "avx512"}) {
+    if (!md_batch_set_method(method)) continue;
+    ASSERT_TRUE(string(md_batch_method()) == method);
+
+    for (size_t batch_size : {1, 3, 4, 7, 9, 17, 31, 201}) {
+      for (size_t start = 0; start < inputs.size(); start += batch_size) {
+        vector<string> batch(inputs.begin() + start,
+                             inputs.begin() + min(start + batch_size, inputs.size()));
+        vector<md_digest_t> digests;
+        md_map_batch(digests, batch);
+        ASSERT_TRUE(digests.size() == batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+          md_digest_t digest;
+          md_map(digest.data(), (const uint8_t*)batch[i].data(), batch[i].size());
+          ASSERT_TRUE(digests[i] == digest) << method << ", length " << batch[i].size();
+        }
+      }
+    }
+
+    vector<md_digest_t> digests;
+    md_map_batch(digests, edges);
+    for (size_t i = 0; i < edges.size(); i++) {
+      md_digest_t digest;
+      md_map(digest.data(), (const uint8_t*)edges[i].data(), edges[i].size());
+      ASSERT_TRUE(digests[i] == digest) << method << ", length " << edges[i].size();
+    }
+  }
+
+  ASSERT_FALSE(md_batch_set_method("unknown"));
+  ASSERT_TRUE(md_batch_set_method("auto"));
+}
+
+
+/* Scalars hashed in one batch are those hashed one by one */
+TEST(MdBatchTest, HashToZPBatchMatchesSingle) {
+  BPGroup group;
+  vector<string> urls = {"", "a", "www.example.com", "www.example.com/path",
+                         "www.xyz.com", string(200, 'u')};
+  vector<ZP> urls_zp = hashToZP(urls, group.order);
+  ASSERT_TRUE(urls_zp.size() == urls.size());
+  for (size_t i = 0; i < urls.size(); i++) {
+    ASSERT_TRUE(urls_zp[i] == hashToZP(urls[i], group.order));
+  }
+  ASSERT_TRUE(hashToZP(vector<string>(), group.order).empty());
+}
+
+/* Both session key versions agree, a short buffer is refused */
+TEST(SessionKeyTest, ArrayAndSpanAgree) {
+  G1 g1; g1.setGenerator();
+  G2 g2; g2.setGenerator();
+  GT gt = pairing(g1, g2);
+
+  session_key_t session_key = deriveSessionKey(gt);
+  ASSERT_TRUE(deriveSessionKey(gt) == session_key);
+  uint8_t sym_key[RLC_MD_LEN];
+  ASSERT_TRUE(deriveSessionKey(span<uint8_t>(sym_key, RLC_MD_LEN), gt));
+  ASSERT_TRUE(memcmp(session_key.data(), sym_key, RLC_MD_LEN) == 0);
+  ASSERT_FALSE(deriveSessionKey(span<uint8_t>(sym_key, RLC_MD_LEN - 1), gt));
+
+  ASSERT_FALSE(deriveSessionKey(gt * gt) == session_key);
+}
+
 int main(int argc, char **argv) {
   int rc;
 